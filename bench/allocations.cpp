@@ -0,0 +1,240 @@
+
+// Counts heap allocations per message. The first part runs the relm data
+// path in a single thread: the application fills a pooled payload, the
+// sending protocol stores, schedules and encodes the frame, the receiving
+// protocol decodes it into a recycled buffer, delivers it and acks it. The
+// second part streams messages end to end through the actors via loopback,
+// which includes the allocations of CAF for each message sent between two
+// actors.
+
+#include <new>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+
+#include <caf/all.hpp>
+#include <caf/config.hpp>
+
+#include <caf/io/all.hpp>
+#include <caf/io/middleman.hpp>
+
+#include "include/framing.hpp"
+#include "include/ping_pong.hpp"
+#include "include/buffer_pool.hpp"
+#include "include/reliability_protocol.hpp"
+#include "include/reliability_actor.hpp"
+#include "include/unreliable_broker.hpp"
+
+#include "bench/endpoints.hpp"
+
+namespace {
+
+std::atomic<uint64_t> num_allocations{0};
+
+} // namespace anonymous
+
+void* operator new(size_t size) {
+  num_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (auto ptr = std::malloc(size > 0 ? size : 1))
+    return ptr;
+  throw std::bad_alloc{};
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+  std::free(ptr);
+}
+
+using namespace std;
+using namespace std::chrono;
+using namespace caf;
+using namespace relm;
+using namespace relm::bench;
+
+namespace {
+
+class config : public actor_system_config {
+public:
+  size_t num_messages = 100000;
+  size_t payload_size = 64;
+  size_t warmup = 10000;
+  uint32_t timeout_s = 300;
+
+  config() {
+    opt_group grp{custom_options_, "global"};
+    grp.add(num_messages, "num-messages,n", "set number of messages")
+    .add(payload_size, "payload-size,s", "set payload bytes per message")
+    .add(warmup, "warmup", "set messages before counting in the data path")
+    .add(timeout_s, "timeout", "set max. runtime (s)");
+  }
+};
+
+// One endpoint of the data path: a protocol instance whose frames go into
+// `wire`, which the loop below decodes and feeds to the peer.
+struct endpoint {
+  reliability_protocol protocol;
+  byte_buffer wire;
+  uint64_t delivered = 0;
+
+  void start(const reliability_config& cfg, actor_id id) {
+    protocol.init(cfg);
+    protocol_hooks hooks;
+    hooks.write = [this](const reliable_msg& msg) {
+      encode(wire, msg);
+    };
+    hooks.deliver = [this](const reliable_msg& msg, milliseconds) {
+      delivered += msg.payload.size();
+    };
+    hooks.deliver_batch = [this](vector<reliable_msg> xs, milliseconds) {
+      for (auto& x : xs)
+        delivered += x.payload.size();
+    };
+    hooks.backpressure = [](bool) {};
+    // the loop calls tick() itself and runs without delayed acks
+    hooks.schedule = [](protocol_timer, milliseconds) {};
+    protocol.start(move(hooks), id);
+  }
+
+  // Hands all frames written since the last call to `peer` and reports
+  // them as written. Returns false on malformed frames.
+  bool transfer(endpoint& peer) {
+    size_t offset = 0;
+    while (offset < wire.size()) {
+      frame_view view;
+      if (decode(wire.data() + offset, wire.size() - offset, view)
+          != decode_status::complete)
+        return false;
+      offset += view.size();
+      auto msg = view.to_msg();
+      peer.protocol.receive(msg);
+    }
+    wire.clear();
+    protocol.written(offset);
+    return true;
+  }
+};
+
+// Returns the allocations per message of the data path in steady state.
+double data_path(const config& cfg) {
+  reliability_config rcfg;
+  // acks go out every few frames instead of waiting for a timer
+  rcfg.ack_delay = milliseconds{0};
+  endpoint sender;
+  endpoint receiver;
+  // the hooks refer to the endpoints, which must not move anymore
+  sender.start(rcfg, 1);
+  receiver.start(rcfg, 2);
+  uint64_t start = 0;
+  for (size_t i = 0; i < cfg.warmup + cfg.num_messages; ++i) {
+    if (i == cfg.warmup)
+      start = num_allocations.load();
+    auto buf = make_buffer();
+    write_int(buf->bytes, now_ns());
+    buf->bytes.resize(cfg.payload_size);
+    sender.protocol.send(reliable_msg::msg(payload_atom::value,
+                                           shared_payload{move(buf)}));
+    if (!sender.transfer(receiver) || !receiver.transfer(sender))
+      return -1;
+    if (i % 64 == 0) {
+      sender.protocol.tick();
+      receiver.protocol.tick();
+    }
+  }
+  auto count = num_allocations.load() - start;
+  if (receiver.delivered != (cfg.warmup + cfg.num_messages)
+                            * cfg.payload_size)
+    return -1;
+  return static_cast<double>(count) / cfg.num_messages;
+}
+
+// Returns the allocations per message streaming through all actors.
+double end_to_end(actor_system& system, const config& cfg) {
+  reliability_config rcfg;
+  broker_config bcfg;
+  bcfg.impairment.loss_rate = 0;
+  bcfg.impairment.delay = milliseconds{0};
+  scoped_actor self{system};
+  auto listener = actor_cast<actor>(self);
+  auto num = cfg.num_messages;
+  app_factory make_sink = [=](actor_system& sys) {
+    return sys.spawn(sink, num, listener, uint32_t{0});
+  };
+  uint16_t port = 0;
+  auto server = system.middleman().spawn_server(relm::server, port, make_sink,
+                                                rcfg, bcfg);
+  if (!server) {
+    std::cerr << "failed to spawn server: "
+              << system.render(server.error()) << endl;
+    return -1;
+  }
+  auto src = system.spawn(source, cfg.num_messages, cfg.payload_size,
+                          uint16_t{1});
+  auto src_reliability = system.spawn(init_reliability_actor, src, rcfg);
+  auto client = system.middleman().spawn_client(broker_impl, "localhost", port,
+                                                src_reliability, bcfg);
+  auto shutdown = [&] {
+    for (auto& x : {src, src_reliability, *server})
+      self->send_exit(x, exit_reason::user_shutdown);
+  };
+  if (!client) {
+    std::cerr << "failed to spawn client: "
+              << system.render(client.error()) << endl;
+    shutdown();
+    return -1;
+  }
+  auto start = num_allocations.load();
+  send_as(src_reliability, src, kickoff_atom::value, src_reliability);
+  auto res = -1.0;
+  self->receive(
+    [&](done_atom, vector<int64_t>&, uint64_t) {
+      auto count = num_allocations.load() - start;
+      res = static_cast<double>(count) / cfg.num_messages;
+    },
+    after(seconds(cfg.timeout_s)) >> [&] {
+      std::cerr << "timed out after " << cfg.timeout_s << "s" << endl;
+    }
+  );
+  shutdown();
+  return res;
+}
+
+void caf_main(actor_system& system, const config& cfg) {
+  if (cfg.payload_size < sizeof(int64_t)) {
+    std::cerr << "payload size must be at least " << sizeof(int64_t)
+              << " bytes to hold a timestamp" << endl;
+    return;
+  }
+  cout << fixed << setprecision(2)
+       << "data path:       " << data_path(cfg) << " allocations/msg" << endl;
+  auto pooled = pool_allocations();
+  auto res = end_to_end(system, cfg);
+  if (res < 0)
+    return;
+  cout << "end to end:      " << res << " allocations/msg" << endl
+       << "pooled buffers:  " << pool_allocations() - pooled
+       << " allocated end to end" << endl;
+}
+
+} // namespace anonymous
+
+CAF_MAIN(io::middleman)
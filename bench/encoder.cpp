@@ -0,0 +1,133 @@
+
+// Compares the per-field write + flush path the broker used to take with
+// batched frame encoding. Each flush is modeled as one write(2) on a local
+// stream socket that is drained by a separate thread.
+
+#include <thread>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <iostream>
+#include <functional>
+
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "include/framing.hpp"
+#include "include/reliable_msg.hpp"
+
+using namespace std;
+using namespace std::chrono;
+using namespace relm;
+
+namespace {
+
+void write_all(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    auto res = ::write(fd, data, size);
+    if (res < 0) {
+      perror("write");
+      exit(EXIT_FAILURE);
+    }
+    data += res;
+    size -= static_cast<size_t>(res);
+  }
+}
+
+void drain(int fd, size_t expected) {
+  vector<char> buf(65536);
+  while (expected > 0) {
+    auto res = ::read(fd, buf.data(), buf.size());
+    if (res <= 0) {
+      perror("read");
+      exit(EXIT_FAILURE);
+    }
+    expected -= static_cast<size_t>(res);
+  }
+}
+
+// Sends `num` messages of `msg_size` bytes on the wire via `fun` and prints
+// the achieved message rate.
+void run(const string& name, size_t num, size_t msg_size,
+         const function<void (int, const reliable_msg&)>& fun,
+         const function<void (int)>& done) {
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+    perror("socketpair");
+    exit(EXIT_FAILURE);
+  }
+  thread reader{drain, fds[1], num * msg_size};
+  auto start = steady_clock::now();
+  for (size_t i = 0; i < num; ++i) {
+    auto msg = reliable_msg::msg(caf::atom("ping"), 1,
+                                 static_cast<seq_num>(i));
+    // keeps the frame size constant, the varint distance to `seq` stays 0
+    msg.stream_seq = msg.seq;
+    fun(fds[0], msg);
+  }
+  done(fds[0]);
+  reader.join();
+  auto elapsed = duration_cast<duration<double>>(steady_clock::now() - start);
+  cout << name << ": " << static_cast<size_t>(num / elapsed.count())
+       << " msgs/sec" << endl;
+  close(fds[0]);
+  close(fds[1]);
+}
+
+} // namespace anonymous
+
+int main(int argc, char** argv) {
+  size_t num = argc > 1 ? std::stoul(argv[1]) : 1000000;
+  auto ping = reliable_msg::msg(caf::atom("ping"), 1, 1000);
+  ping.stream_seq = ping.seq;
+  auto acked = ping;
+  acked.flags |= has_acks;
+  acked.ack_seq = 500;
+  acked.window = 1024;
+  acked.sacks = {{502, 510}, {520, 520}};
+  cout << "frame sizes: ack " << encoded_size(reliable_msg::ack(500))
+       << " bytes, ping " << encoded_size(ping)
+       << " bytes, ping with acks and 2 SACK ranges " << encoded_size(acked)
+       << " bytes" << endl;
+  byte_buffer buf;
+  // previous path: write and flush every 32 bit word of the fixed size
+  // message layout (8 byte atom, content, seq, num_nacks, 3 nacks) on its own
+  run("write_int + flush per field", num, 8 * sizeof(uint32_t),
+      [&](int fd, const reliable_msg& msg) {
+        auto flush_int = [&](uint32_t x) {
+          buf.clear();
+          write_int(buf, x);
+          write_all(fd, buf.data(), buf.size());
+        };
+        auto atm = static_cast<uint64_t>(msg.atm);
+        flush_int(static_cast<uint32_t>(atm));
+        flush_int(static_cast<uint32_t>(atm >> 32));
+        flush_int(static_cast<uint32_t>(msg.content()));
+        flush_int(static_cast<uint32_t>(msg.seq));
+        for (int i = 0; i < 4; ++i)
+          flush_int(0);
+      },
+      [](int) { });
+  buf.clear();
+  auto frame_size = encode(buf, reliable_msg::msg(caf::atom("ping"), 1, 0));
+  for (size_t batch_size : {1, 8, 32, 128}) {
+    size_t pending = 0;
+    buf.clear();
+    auto flush = [&](int fd) {
+      write_all(fd, buf.data(), buf.size());
+      buf.clear();
+      pending = 0;
+    };
+    run("encode, batch size " + to_string(batch_size), num, frame_size,
+        [&](int fd, const reliable_msg& msg) {
+          encode(buf, msg);
+          if (++pending >= batch_size)
+            flush(fd);
+        },
+        [&](int fd) {
+          if (pending > 0)
+            flush(fd);
+        });
+  }
+}
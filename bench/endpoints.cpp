@@ -0,0 +1,269 @@
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+
+#include <caf/io/all.hpp>
+#include <caf/io/middleman.hpp>
+
+#include "include/trace.hpp"
+#include "include/framing.hpp"
+#include "include/ping_pong.hpp"
+#include "include/reliability_actor.hpp"
+
+#include "bench/endpoints.hpp"
+
+using namespace std;
+using namespace std::chrono;
+using namespace caf;
+
+namespace relm {
+namespace bench {
+
+namespace {
+
+// number of messages the source sends before yielding to its mailbox
+constexpr size_t burst_size = 64;
+
+} // namespace anonymous
+
+int64_t now_ns() {
+  return duration_cast<nanoseconds>(
+           steady_clock::now().time_since_epoch()).count();
+}
+
+behavior source(stateful_actor<source_state>* self, size_t num,
+                size_t payload_size, uint16_t streams) {
+  auto schedule = [=] {
+    if (!self->state.scheduled && !self->state.paused
+        && self->state.sent < num) {
+      self->state.scheduled = true;
+      self->send(self, continue_atom::value);
+    }
+  };
+  return {
+    [=](kickoff_atom, const actor& reliability) {
+      self->state.out = reliability;
+      schedule();
+    },
+    [=](continue_atom) {
+      auto& st = self->state;
+      st.scheduled = false;
+      for (size_t i = 0; i < burst_size && st.sent < num && !st.paused; ++i) {
+        // fill a recycled buffer, all layers share it from here on
+        auto buf = make_buffer();
+        write_int(buf->bytes, now_ns());
+        buf->bytes.resize(payload_size);
+        auto stream = static_cast<uint16_t>(st.sent % streams);
+        self->send(st.out, stream_atom::value, stream, payload_atom::value,
+                   shared_payload{move(buf)});
+        ++st.sent;
+      }
+      schedule();
+    },
+    [=](pause_atom) {
+      self->state.paused = true;
+    },
+    [=](resume_atom) {
+      self->state.paused = false;
+      schedule();
+    }
+  };
+}
+
+behavior sink(stateful_actor<sink_state>* self, size_t num,
+              const actor& listener, uint32_t credit) {
+  self->state.latencies.reserve(num);
+  auto step = std::max(credit / 2, uint32_t{1});
+  auto consume = [=](const shared_payload& payload) {
+    int64_t sent_at = 0;
+    read_int(payload.data(), sent_at);
+    auto& st = self->state;
+    st.latencies.push_back(now_ns() - sent_at);
+    st.bytes += payload.size();
+    ++st.consumed;
+  };
+  auto done = [=] {
+    auto& st = self->state;
+    if (credit > 0 && st.consumed >= step) {
+      auto n = st.consumed - st.consumed % step;
+      st.consumed -= n;
+      self->send(actor_cast<actor>(self->current_sender()),
+                 credit_atom::value, n);
+    }
+    if (st.latencies.size() == num) {
+      self->send(listener, done_atom::value, move(st.latencies), st.bytes);
+      self->quit();
+    }
+  };
+  return {
+    [=](payload_atom, const shared_payload& payload) {
+      consume(payload);
+      done();
+    },
+    [=](batch_atom, const vector<reliable_msg>& batch) {
+      for (auto& x : batch)
+        consume(x.payload);
+      done();
+    }
+  };
+}
+
+double percentile(const vector<int64_t>& xs, double q) {
+  if (xs.empty())
+    return 0;
+  auto idx = min(xs.size() - 1, static_cast<size_t>(q * xs.size()));
+  return xs[idx] / 1000.0;
+}
+
+void print_latency_header(ostream& out) {
+  out << setw(12) << "p50 us"
+      << setw(12) << "p99 us"
+      << setw(12) << "p999 us"
+      << setw(12) << "max us";
+}
+
+void print_latencies(ostream& out, const vector<int64_t>& xs) {
+  out << setw(12) << percentile(xs, 0.5)
+      << setw(12) << percentile(xs, 0.99)
+      << setw(12) << percentile(xs, 0.999)
+      << setw(12) << percentile(xs, 1.0);
+}
+
+bool check_payload_size(size_t size) {
+  if (size >= sizeof(int64_t))
+    return true;
+  std::cerr << "payload size must be at least " << sizeof(int64_t)
+            << " bytes to hold a timestamp" << endl;
+  return false;
+}
+
+bench_config::bench_config() {
+  // measure a perfect network unless asked otherwise
+  impairment.loss_rate = 0;
+  impairment.delay_ms = 0;
+  opt_group grp{custom_options_, "global"};
+  grp.add(window_size, "window-size,w", "set max. unacknowledged frames")
+  .add(ack_delay_ms, "ack-delay", "set max. delay of standalone acks (ms)")
+  .add(congestion, "congestion",
+       "set congestion control algorithm (none, aimd, cubic)")
+  .add(batch_size, "batch-size,b", "set max. frames per write batch")
+  .add(linger_us, "linger", "set max. frame delay before flushing (us)")
+  .add(timeout_s, "timeout", "set max. time without a finished run (s)")
+  .add(trace_level, "trace-level,t",
+       "set trace level (off, error, warning, info, debug, trace)");
+  impairment.add(grp);
+}
+
+bool bench_config::init(reliability_config& rcfg,
+                        broker_config& bcfg) const {
+  auto level = trace::parse_level(trace_level);
+  if (level < 0) {
+    std::cerr << "invalid trace level: " << trace_level << endl;
+    return false;
+  }
+  trace::set_level(level);
+  trace::start(std::cerr);
+  bcfg.batch_size = batch_size;
+  bcfg.linger = microseconds{linger_us};
+  auto err = impairment.convert(bcfg.impairment);
+  if (!err.empty()) {
+    std::cerr << err << endl;
+    return false;
+  }
+  rcfg.window_size = window_size;
+  rcfg.ack_delay = milliseconds{ack_delay_ms};
+  if (!parse_congestion_algorithm(congestion, rcfg.congestion)) {
+    std::cerr << "invalid congestion control algorithm: " << congestion
+              << endl;
+    return false;
+  }
+  return true;
+}
+
+loopback_run::loopback_run(actor_system& sys, const reliability_config& rcfg,
+                           const broker_config& bcfg)
+    : sys_(sys),
+      self_{sys},
+      rcfg_(rcfg),
+      bcfg_(bcfg),
+      port_{0} {
+  // nop
+}
+
+loopback_run::~loopback_run() {
+  for (auto& x : clients_)
+    for (auto& y : {x.first, x.second})
+      if (y)
+        self_->send_exit(y, exit_reason::user_shutdown);
+  if (server_)
+    self_->send_exit(server_, exit_reason::user_shutdown);
+}
+
+bool loopback_run::listen(app_factory make_app) {
+  auto server = sys_.middleman().spawn_server(relm::server, port_,
+                                              move(make_app), rcfg_, bcfg_);
+  if (!server) {
+    std::cerr << "failed to spawn server: " << sys_.render(server.error())
+              << endl;
+    return false;
+  }
+  server_ = *server;
+  return true;
+}
+
+actor loopback_run::connect(const actor& app, const broker_config& bcfg) {
+  actor out;
+  expected<actor> client = make_error(sec::cannot_connect_to_node);
+  if (bcfg.fused) {
+    client = sys_.middleman().spawn_client(fused_broker, "localhost", port_,
+                                           app, rcfg_, bcfg);
+    if (client)
+      out = *client;
+  } else {
+    out = sys_.spawn(init_reliability_actor, app, rcfg_);
+    client = sys_.middleman().spawn_client(broker_impl, "localhost", port_,
+                                           out, bcfg);
+  }
+  // the destructor shuts down `app` even if connecting failed
+  clients_.emplace_back(app, out);
+  if (!client) {
+    std::cerr << "failed to spawn client: " << sys_.render(client.error())
+              << endl;
+    return {};
+  }
+  return out;
+}
+
+bool loopback_run::run(size_t num_sinks, seconds timeout, run_result& res) {
+  auto start = steady_clock::now();
+  for (auto& x : clients_)
+    self_->send(x.first, kickoff_atom::value, x.second);
+  res.latencies.clear();
+  res.bytes = 0;
+  size_t done = 0;
+  auto timed_out = false;
+  self_->receive_while([&] { return done < num_sinks && !timed_out; })(
+    [&](done_atom, vector<int64_t>& xs, uint64_t bytes) {
+      res.latencies.insert(res.latencies.end(), xs.begin(), xs.end());
+      res.bytes += bytes;
+      ++done;
+    },
+    after(timeout) >> [&] {
+      timed_out = true;
+    }
+  );
+  auto elapsed = steady_clock::now() - start;
+  res.secs = duration_cast<std::chrono::duration<double>>(elapsed).count();
+  if (timed_out) {
+    std::cerr << "timed out after " << timeout.count() << "s with " << done
+              << " of " << num_sinks << " sinks done" << endl;
+    return false;
+  }
+  sort(res.latencies.begin(), res.latencies.end());
+  return true;
+}
+
+} // namespace bench
+} // namespace relm
@@ -0,0 +1,148 @@
+#pragma once
+
+// Application actors and the driver shared by the end-to-end benchmarks.
+
+#include <chrono>
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+#include <caf/all.hpp>
+
+#include "include/unreliable_broker.hpp"
+#include "include/reliability_protocol.hpp"
+
+namespace relm {
+namespace bench {
+
+using payload_atom = caf::atom_constant<caf::atom("payload")>;
+using continue_atom = caf::atom_constant<caf::atom("continue")>;
+using done_atom = caf::atom_constant<caf::atom("done")>;
+
+/// Returns the current time of the steady clock in nanoseconds.
+int64_t now_ns();
+
+struct source_state {
+  caf::actor out;
+  size_t sent = 0;
+  bool paused = false;
+  bool scheduled = false;
+};
+
+/// Sends `num` messages as fast as the reliability actor accepts them after
+/// receiving `(kickoff_atom, reliability)`, assigning them round-robin to
+/// `streams` streams. Each payload starts with the time it was handed to the
+/// reliability layer.
+caf::behavior source(caf::stateful_actor<source_state>* self, size_t num,
+                     size_t payload_size, uint16_t streams);
+
+struct sink_state {
+  std::vector<int64_t> latencies;
+  uint64_t bytes = 0;
+  // messages consumed since granting credit the last time
+  uint32_t consumed = 0;
+};
+
+/// Records the delivery latency of `num` messages and sends
+/// `(done_atom, latencies, bytes)` to `listener` once all arrived. Accepts
+/// single messages as well as batches. Grants
+/// credit in steps of `credit / 2` messages if `credit` is not zero, which
+/// must match the initial credit of the reliability actor.
+caf::behavior sink(caf::stateful_actor<sink_state>* self, size_t num,
+                   const caf::actor& listener, uint32_t credit);
+
+/// Returns the `q`-quantile of the sorted `xs` in microseconds.
+double percentile(const std::vector<int64_t>& xs, double q);
+
+/// Prints the column headers of `print_latencies`.
+void print_latency_header(std::ostream& out);
+
+/// Prints the median, 99th and 99.9th percentile and the maximum of the
+/// sorted `xs` in microseconds.
+void print_latencies(std::ostream& out, const std::vector<int64_t>& xs);
+
+/// Returns false and prints an error if payloads of `size` bytes cannot hold
+/// the timestamp of the source.
+bool check_payload_size(size_t size);
+
+/// Options shared by the end-to-end benchmarks. Each benchmark derives its
+/// config and registers its own options in the constructor. The simulated
+/// network is perfect unless a benchmark or the user asks otherwise.
+class bench_config : public caf::actor_system_config {
+public:
+  size_t window_size = reliability_config{}.window_size;
+  uint32_t ack_delay_ms = reliability_config{}.ack_delay.count();
+  std::string congestion = "aimd";
+  size_t batch_size = broker_config{}.batch_size;
+  uint32_t linger_us = broker_config{}.linger.count();
+  impairment_options impairment;
+  uint32_t timeout_s = 300;
+  std::string trace_level = "warning";
+
+  bench_config();
+
+  /// Starts tracing and converts the options. Prints an error and returns
+  /// false if they are invalid.
+  bool init(reliability_config& rcfg, broker_config& bcfg) const;
+};
+
+/// Results of one benchmark run.
+struct run_result {
+  std::vector<int64_t> latencies;  // sorted, in ns
+  uint64_t bytes = 0;
+  double secs = 0;
+};
+
+/// A server and its clients within one process, connected via loopback.
+/// Sinks report to `listener()`, the destructor shuts down all actors.
+class loopback_run {
+public:
+  loopback_run(caf::actor_system& sys, const reliability_config& rcfg,
+               const broker_config& bcfg);
+
+  loopback_run(const loopback_run&) = delete;
+  loopback_run& operator=(const loopback_run&) = delete;
+
+  ~loopback_run();
+
+  caf::scoped_actor& self() {
+    return self_;
+  }
+
+  caf::actor listener() {
+    return caf::actor_cast<caf::actor>(self_);
+  }
+
+  /// Spawns the server, which creates an application via `make_app` for
+  /// each connection. Prints an error and returns false on failure.
+  bool listen(app_factory make_app);
+
+  /// Connects `app` to the server via a reliability actor, or a fused
+  /// broker with `bcfg.fused`. Returns the actor `app` sends to, or an
+  /// invalid handle after printing an error.
+  caf::actor connect(const caf::actor& app, const broker_config& bcfg);
+
+  caf::actor connect(const caf::actor& app) {
+    return connect(app, bcfg_);
+  }
+
+  /// Kicks off all connected applications and collects the results of
+  /// `num_sinks` sinks. Prints an error and returns false if no sink
+  /// finished for `timeout`.
+  bool run(size_t num_sinks, std::chrono::seconds timeout, run_result& res);
+
+private:
+  caf::actor_system& sys_;
+  caf::scoped_actor self_;
+  reliability_config rcfg_;
+  broker_config bcfg_;
+  uint16_t port_;
+  caf::actor server_;
+  // applications and the actors they send to
+  std::vector<std::pair<caf::actor, caf::actor>> clients_;
+};
+
+} // namespace bench
+} // namespace relm
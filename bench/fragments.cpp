@@ -0,0 +1,92 @@
+
+// Streams messages of 1 KB up to 64 MB through one session via loopback,
+// one run per size with about the same number of bytes each. Messages above
+// the fragment size travel as fragments that are acked and retransmitted
+// individually and reassembled at the receiver. Reports goodput and the
+// delivery latency of whole messages per size.
+
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+
+#include <caf/all.hpp>
+#include <caf/config.hpp>
+
+#include <caf/io/all.hpp>
+#include <caf/io/middleman.hpp>
+
+#include "bench/endpoints.hpp"
+
+using namespace std;
+using namespace std::chrono;
+using namespace caf;
+using namespace relm;
+using namespace relm::bench;
+
+namespace {
+
+class config : public bench_config {
+public:
+  size_t num_bytes = 256 * 1024 * 1024;
+  size_t min_size = 1024;
+  size_t max_size = 64 * 1024 * 1024;
+  size_t fragment_size = reliability_config{}.max_fragment_size;
+
+  config() {
+    opt_group grp{custom_options_, "global"};
+    grp.add(num_bytes, "num-bytes,n", "set payload bytes per run")
+    .add(min_size, "min-size", "set message size of the first run")
+    .add(max_size, "max-size", "set message size of the last run")
+    .add(fragment_size, "fragment-size",
+         "set max. payload bytes per frame (0: as large as frames allow)");
+  }
+};
+
+// Streams messages of `size` bytes, returns false on errors or timeouts.
+bool run(actor_system& system, const config& cfg,
+         const reliability_config& rcfg, const broker_config& bcfg,
+         size_t size) {
+  // at least two messages for a percentile worth printing
+  auto num = std::max(cfg.num_bytes / size, size_t{2});
+  loopback_run lr{system, rcfg, bcfg};
+  auto listener = lr.listener();
+  auto make_sink = [=](actor_system& sys) {
+    return sys.spawn(sink, num, listener, uint32_t{0});
+  };
+  if (!lr.listen(make_sink))
+    return false;
+  auto src = system.spawn(source, num, size, uint16_t{1});
+  run_result res;
+  if (!lr.connect(src) || !lr.run(1, seconds(cfg.timeout_s), res))
+    return false;
+  cout << setw(12) << size
+       << setw(10) << num
+       << setw(12) << res.bytes / res.secs / (1024 * 1024);
+  print_latencies(cout, res.latencies);
+  cout << endl;
+  return true;
+}
+
+void caf_main(actor_system& system, const config& cfg) {
+  reliability_config rcfg;
+  broker_config bcfg;
+  if (!cfg.init(rcfg, bcfg) || !check_payload_size(cfg.min_size))
+    return;
+  rcfg.max_fragment_size = cfg.fragment_size;
+  cout << "impairment seed: " << bcfg.impairment.seed << endl
+       << fixed << setprecision(2)
+       << setw(12) << "bytes"
+       << setw(10) << "msgs"
+       << setw(12) << "MiB/sec";
+  print_latency_header(cout);
+  cout << endl;
+  for (auto size = cfg.min_size; size <= cfg.max_size; size *= 4)
+    if (!run(system, cfg, rcfg, bcfg, size))
+      return;
+}
+
+} // namespace anonymous
+
+CAF_MAIN(io::middleman)
@@ -0,0 +1,82 @@
+
+// Compares the actor pipeline with the fused broker: a source streams
+// messages through one session via loopback, first with a reliability actor
+// between application and broker on both sides, then with the protocol
+// running inside the brokers. The fused run saves two mailbox hops per
+// message on each side. Both runs use the same impairment seed.
+
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+
+#include <caf/all.hpp>
+#include <caf/config.hpp>
+
+#include <caf/io/all.hpp>
+#include <caf/io/middleman.hpp>
+
+#include "bench/endpoints.hpp"
+
+using namespace std;
+using namespace std::chrono;
+using namespace caf;
+using namespace relm;
+using namespace relm::bench;
+
+namespace {
+
+class config : public bench_config {
+public:
+  size_t num_messages = 100000;
+  size_t payload_size = 64;
+
+  config() {
+    opt_group grp{custom_options_, "global"};
+    grp.add(num_messages, "num-messages,n", "set number of messages")
+    .add(payload_size, "payload-size,s", "set payload bytes per message");
+  }
+};
+
+// Streams all messages through the pipeline or the fused brokers, returns
+// false on errors or timeouts.
+bool run(actor_system& system, const config& cfg,
+         const reliability_config& rcfg, broker_config bcfg, bool fused) {
+  bcfg.fused = fused;
+  loopback_run lr{system, rcfg, bcfg};
+  auto listener = lr.listener();
+  auto num = cfg.num_messages;
+  auto make_sink = [=](actor_system& sys) {
+    return sys.spawn(sink, num, listener, uint32_t{0});
+  };
+  if (!lr.listen(make_sink))
+    return false;
+  auto src = system.spawn(source, num, cfg.payload_size, uint16_t{1});
+  run_result res;
+  if (!lr.connect(src) || !lr.run(1, seconds(cfg.timeout_s), res))
+    return false;
+  cout << setw(10) << (fused ? "fused" : "pipeline")
+       << setw(14) << res.latencies.size() / res.secs;
+  print_latencies(cout, res.latencies);
+  cout << endl;
+  return true;
+}
+
+void caf_main(actor_system& system, const config& cfg) {
+  reliability_config rcfg;
+  broker_config bcfg;
+  if (!cfg.init(rcfg, bcfg) || !check_payload_size(cfg.payload_size))
+    return;
+  cout << "impairment seed: " << bcfg.impairment.seed << endl
+       << fixed << setprecision(2)
+       << setw(10) << "mode"
+       << setw(14) << "msgs/sec";
+  print_latency_header(cout);
+  cout << endl;
+  if (run(system, cfg, rcfg, bcfg, false))
+    run(system, cfg, rcfg, bcfg, true);
+}
+
+} // namespace anonymous
+
+CAF_MAIN(io::middleman)
@@ -0,0 +1,142 @@
+// Measures the output scheduler: both endpoints stream messages to each
+// other through one session via loopback, so acks and retransmissions share
+// the way to the broker with bulk data. The first run hands every frame to
+// the broker right away and leaves it in mailbox order, the second holds
+// frames back above `--max-pending-bytes` and lets acks and retransmissions
+// overtake new data. Both runs use the same impairment seed.
+
+#include <chrono>
+#include <memory>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+
+#include <caf/all.hpp>
+#include <caf/config.hpp>
+
+#include <caf/io/all.hpp>
+#include <caf/io/middleman.hpp>
+
+#include "include/metrics.hpp"
+#include "include/ping_pong.hpp"
+#include "include/reliability_actor.hpp"
+
+#include "bench/endpoints.hpp"
+
+using namespace std;
+using namespace std::chrono;
+using namespace caf;
+using namespace relm;
+using namespace relm::bench;
+
+namespace {
+
+class config : public bench_config {
+public:
+  size_t num_messages = 100000;
+  size_t payload_size = 1024;
+  size_t max_pending_bytes = reliability_config{}.max_pending_bytes;
+
+  config() {
+    // a little loss gives retransmissions something to overtake
+    impairment.loss_rate = 0.01;
+    opt_group grp{custom_options_, "global"};
+    grp.add(num_messages, "num-messages,n",
+            "set number of messages per direction")
+    .add(payload_size, "payload-size,s", "set payload bytes per message")
+    .add(max_pending_bytes, "max-pending-bytes",
+         "set max. bytes handed to the broker but not written yet");
+  }
+};
+
+// Streams `num` messages to the peer and records the latency of the `num`
+// messages coming the other way. Starts sending on `(kickoff_atom,
+// reliability)` or with the first message from the peer.
+behavior duplex(event_based_actor* self, size_t num, size_t payload_size,
+                const actor& listener) {
+  auto src = self->spawn<linked>(source, num, payload_size, uint16_t{1});
+  auto snk = self->spawn<linked>(sink, num, listener, uint32_t{0});
+  auto started = std::make_shared<bool>(false);
+  auto start = [=](const actor& reliability) {
+    if (!*started) {
+      *started = true;
+      self->send(src, kickoff_atom::value, reliability);
+    }
+  };
+  return {
+    [=](kickoff_atom, const actor& reliability) {
+      start(reliability);
+    },
+    [=](payload_atom, shared_payload& payload) {
+      start(actor_cast<actor>(self->current_sender()));
+      self->send(snk, payload_atom::value, move(payload));
+    },
+    [=](pause_atom) {
+      self->send(src, pause_atom::value);
+    },
+    [=](resume_atom) {
+      self->send(src, resume_atom::value);
+    }
+  };
+}
+
+// Streams all messages in both directions, returns false on errors or
+// timeouts.
+bool run(actor_system& system, const config& cfg, reliability_config rcfg,
+         const broker_config& bcfg, size_t max_pending_bytes) {
+  rcfg.max_pending_bytes = max_pending_bytes;
+  loopback_run lr{system, rcfg, bcfg};
+  auto listener = lr.listener();
+  auto num = cfg.num_messages;
+  auto payload_size = cfg.payload_size;
+  auto make_app = [=](actor_system& sys) {
+    return sys.spawn(duplex, num, payload_size, listener);
+  };
+  if (!lr.listen(make_app))
+    return false;
+  auto app = system.spawn(duplex, num, payload_size, listener);
+  auto reliability = lr.connect(app);
+  // one sink per direction
+  run_result res;
+  if (!reliability || !lr.run(2, seconds(cfg.timeout_s), res))
+    return false;
+  metrics_map metrics;
+  lr.self()->request(reliability, infinite, metrics_atom::value).receive(
+    [&](metrics_map& xs) {
+      metrics = move(xs);
+    },
+    [&](error& err) {
+      std::cerr << "failed to query metrics: " << system.render(err) << endl;
+    }
+  );
+  cout << setw(10) << (max_pending_bytes == 0 ? "fifo" : "priority")
+       << setw(14) << res.latencies.size() / res.secs;
+  print_latencies(cout, res.latencies);
+  cout << setw(12) << metrics["rtt_us_p99"]
+       << setw(10) << metrics["retransmitted"] << endl;
+  return true;
+}
+
+void caf_main(actor_system& system, const config& cfg) {
+  reliability_config rcfg;
+  broker_config bcfg;
+  if (!cfg.init(rcfg, bcfg) || !check_payload_size(cfg.payload_size))
+    return;
+  if (cfg.max_pending_bytes == 0) {
+    std::cerr << "max. pending bytes must not be 0" << endl;
+    return;
+  }
+  cout << "impairment seed: " << bcfg.impairment.seed << endl
+       << fixed << setprecision(2)
+       << setw(10) << "mode"
+       << setw(14) << "msgs/sec";
+  print_latency_header(cout);
+  cout << setw(12) << "rtt p99 us"
+       << setw(10) << "retx" << endl;
+  if (run(system, cfg, rcfg, bcfg, 0))
+    run(system, cfg, rcfg, bcfg, cfg.max_pending_bytes);
+}
+
+} // namespace anonymous
+
+CAF_MAIN(io::middleman)
@@ -0,0 +1,97 @@
+
+// Ramps the number of concurrent clients of a single server: each step
+// connects 1, 2, 4, ... clients via loopback that all stream messages at
+// the same time, each into its own session on the server. Prints aggregate
+// throughput and delivery latency per step.
+
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+
+#include <caf/all.hpp>
+#include <caf/config.hpp>
+
+#include <caf/io/all.hpp>
+#include <caf/io/middleman.hpp>
+
+#include "bench/endpoints.hpp"
+
+using namespace std;
+using namespace std::chrono;
+using namespace caf;
+using namespace relm;
+using namespace relm::bench;
+
+namespace {
+
+class config : public bench_config {
+public:
+  size_t max_clients = 256;
+  size_t num_messages = 10000;
+  size_t payload_size = 64;
+  uint32_t credit = 0;
+
+  config() {
+    opt_group grp{custom_options_, "global"};
+    grp.add(max_clients, "max-clients,c", "set number of clients in last step")
+    .add(num_messages, "num-messages,n", "set number of messages per client")
+    .add(payload_size, "payload-size,s", "set payload bytes per message")
+    .add(credit, "credit", "set application credit (0: unlimited)");
+  }
+};
+
+// Runs one step with `num_clients` concurrent clients, returns false on
+// errors or timeouts.
+bool run(actor_system& system, const config& cfg,
+         const reliability_config& rcfg, const broker_config& bcfg,
+         size_t num_clients) {
+  loopback_run lr{system, rcfg, bcfg};
+  auto listener = lr.listener();
+  auto num = cfg.num_messages;
+  auto credit = cfg.credit;
+  auto make_sink = [=](actor_system& sys) {
+    return sys.spawn(sink, num, listener, credit);
+  };
+  if (!lr.listen(make_sink))
+    return false;
+  for (size_t i = 0; i < num_clients; ++i) {
+    auto src = system.spawn(source, num, cfg.payload_size, uint16_t{1});
+    // keep the client seeds apart from the server's seed + n
+    auto client_cfg = bcfg;
+    client_cfg.impairment.seed += 1000000 * (i + 1);
+    if (!lr.connect(src, client_cfg))
+      return false;
+  }
+  run_result res;
+  if (!lr.run(num_clients, seconds(cfg.timeout_s), res))
+    return false;
+  cout << setw(8) << num_clients
+       << setw(14) << res.latencies.size() / res.secs
+       << setw(14) << res.bytes / res.secs / (1024 * 1024);
+  print_latencies(cout, res.latencies);
+  cout << endl;
+  return true;
+}
+
+void caf_main(actor_system& system, const config& cfg) {
+  reliability_config rcfg;
+  broker_config bcfg;
+  if (!cfg.init(rcfg, bcfg) || !check_payload_size(cfg.payload_size))
+    return;
+  rcfg.initial_credit = cfg.credit;
+  cout << "impairment seed: " << bcfg.impairment.seed << endl
+       << fixed << setprecision(2)
+       << setw(8) << "clients"
+       << setw(14) << "msgs/sec"
+       << setw(14) << "MiB/sec";
+  print_latency_header(cout);
+  cout << endl;
+  for (size_t n = 1; n <= cfg.max_clients; n *= 2)
+    if (!run(system, cfg, rcfg, bcfg, n))
+      return;
+}
+
+} // namespace anonymous
+
+CAF_MAIN(io::middleman)
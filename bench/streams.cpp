@@ -0,0 +1,90 @@
+
+// Compares delivery latency of a single sequence with independent streams:
+// a source streams messages through one session via loopback, first on a
+// single stream and then spread round-robin over `--streams` streams. With
+// losses, a gap holds back all later messages of a single sequence but only
+// those of the same stream otherwise. Both runs use the same impairment seed.
+
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+
+#include <caf/all.hpp>
+#include <caf/config.hpp>
+
+#include <caf/io/all.hpp>
+#include <caf/io/middleman.hpp>
+
+#include "bench/endpoints.hpp"
+
+using namespace std;
+using namespace std::chrono;
+using namespace caf;
+using namespace relm;
+using namespace relm::bench;
+
+namespace {
+
+class config : public bench_config {
+public:
+  size_t num_messages = 100000;
+  size_t payload_size = 64;
+  uint16_t streams = 16;
+
+  config() {
+    // a lossy link without extra delay, the RTT comes from loopback
+    impairment.loss_rate = 0.01;
+    opt_group grp{custom_options_, "global"};
+    grp.add(num_messages, "num-messages,n", "set number of messages")
+    .add(payload_size, "payload-size,s", "set payload bytes per message")
+    .add(streams, "streams", "set number of streams in the second run");
+  }
+};
+
+// Streams all messages over `num_streams` streams, returns false on errors
+// or timeouts.
+bool run(actor_system& system, const config& cfg,
+         const reliability_config& rcfg, const broker_config& bcfg,
+         uint16_t num_streams) {
+  loopback_run lr{system, rcfg, bcfg};
+  auto listener = lr.listener();
+  auto num = cfg.num_messages;
+  auto make_sink = [=](actor_system& sys) {
+    return sys.spawn(sink, num, listener, uint32_t{0});
+  };
+  if (!lr.listen(make_sink))
+    return false;
+  auto src = system.spawn(source, num, cfg.payload_size, num_streams);
+  run_result res;
+  if (!lr.connect(src) || !lr.run(1, seconds(cfg.timeout_s), res))
+    return false;
+  cout << setw(8) << num_streams
+       << setw(14) << res.latencies.size() / res.secs;
+  print_latencies(cout, res.latencies);
+  cout << endl;
+  return true;
+}
+
+void caf_main(actor_system& system, const config& cfg) {
+  reliability_config rcfg;
+  broker_config bcfg;
+  if (!cfg.init(rcfg, bcfg) || !check_payload_size(cfg.payload_size))
+    return;
+  if (cfg.streams == 0) {
+    std::cerr << "number of streams must be at least 1" << endl;
+    return;
+  }
+  cout << "impairment seed: " << bcfg.impairment.seed << endl
+       << fixed << setprecision(2)
+       << setw(8) << "streams"
+       << setw(14) << "msgs/sec";
+  print_latency_header(cout);
+  cout << endl;
+  if (run(system, cfg, rcfg, bcfg, 1) && cfg.streams > 1)
+    run(system, cfg, rcfg, bcfg, cfg.streams);
+}
+
+} // namespace anonymous
+
+CAF_MAIN(io::middleman)
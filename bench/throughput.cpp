@@ -0,0 +1,250 @@
+
+// Measures the cost of reliability end to end: a source streams messages
+// through a reliability actor and a broker to a sink in the same process,
+// connected via loopback TCP or UDP. The brokers drop and delay incoming
+// frames as configured, the sink records the delivery latency of each
+// message.
+
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+
+#include <caf/all.hpp>
+#include <caf/config.hpp>
+
+#include <caf/io/all.hpp>
+#include <caf/io/middleman.hpp>
+
+#include "include/framing.hpp"
+#include "include/metrics.hpp"
+#include "include/ping_pong.hpp"
+#include "include/reliability_actor.hpp"
+#include "include/unreliable_broker.hpp"
+#include "include/datagram_transport.hpp"
+
+#include "bench/endpoints.hpp"
+
+using namespace std;
+using namespace std::chrono;
+using namespace caf;
+using namespace relm;
+using namespace relm::bench;
+
+namespace {
+
+class config : public bench_config {
+public:
+  size_t num_messages = 100000;
+  size_t payload_size = 64;
+  uint32_t credit = 0;
+  bool batch_delivery = false;
+  size_t fec_group = 0;
+  bool fec_adaptive = false;
+  uint32_t initial_seq = reliability_config{}.initial_seq;
+  std::string transport = "tcp";
+  std::string metrics_file;
+
+  config() {
+    opt_group grp{custom_options_, "global"};
+    grp.add(num_messages, "num-messages,n", "set number of messages")
+    .add(payload_size, "payload-size,s", "set payload bytes per message")
+    .add(credit, "credit", "set application credit (0: unlimited)")
+    .add(batch_delivery, "batch-delivery",
+         "deliver in-order messages to the sink in batches")
+    .add(fec_group, "fec-group", "set data frames per parity frame (0: off)")
+    .add(fec_adaptive, "fec-adaptive",
+         "adapt the FEC group size to the retransmission rate")
+    .add(initial_seq, "initial-seq",
+         "set first sequence number, e.g., 4294967000 to wrap around")
+    .add(transport, "transport", "set transport (tcp, udp)")
+    .add(metrics_file, "metrics-file",
+         "append the metrics of both sessions to this file (default: off)");
+  }
+};
+
+void caf_main(actor_system& system, const config& cfg) {
+  reliability_config rcfg;
+  broker_config bcfg;
+  if (!cfg.init(rcfg, bcfg) || !check_payload_size(cfg.payload_size))
+    return;
+  relm::transport tp;
+  if (!parse_transport(cfg.transport, tp)) {
+    std::cerr << "invalid transport: " << cfg.transport << endl;
+    return;
+  }
+  rcfg.initial_credit = cfg.credit;
+  rcfg.batch_delivery = cfg.batch_delivery;
+  rcfg.fec.group_size = cfg.fec_group;
+  rcfg.fec.adaptive = cfg.fec_adaptive;
+  rcfg.initial_seq = cfg.initial_seq;
+  if (tp == relm::transport::udp)
+    fit_to_datagrams(rcfg);
+  scoped_actor self{system};
+  // receiving side, the server creates a sink for the connection
+  auto listener = actor_cast<actor>(self);
+  auto num = cfg.num_messages;
+  auto credit = cfg.credit;
+  app_factory make_sink = [=](actor_system& sys) {
+    return sys.spawn(sink, num, listener, credit);
+  };
+  uint16_t port = 0;
+  // the TCP server shuts down the sessions it creates, the datagram endpoint
+  // serves a single session that we create up front
+  vector<actor> sink_session;
+  expected<actor> server = make_error(sec::cannot_open_port);
+  if (tp == relm::transport::udp) {
+    auto snk = make_sink(system);
+    auto snk_reliability = system.spawn(init_reliability_actor, snk, rcfg);
+    sink_session = {snk, snk_reliability};
+    server = spawn_datagram_server(system, port, snk_reliability, bcfg);
+  } else {
+    server = system.middleman().spawn_server(relm::server, port, make_sink,
+                                             rcfg, bcfg);
+  }
+  if (!server) {
+    std::cerr << "failed to spawn server: "
+              << system.render(server.error()) << endl;
+    for (auto& x : sink_session)
+      self->send_exit(x, exit_reason::user_shutdown);
+    return;
+  }
+  // sending side
+  auto src = system.spawn(source, cfg.num_messages, cfg.payload_size,
+                          uint16_t{1});
+  auto src_reliability = system.spawn(init_reliability_actor, src, rcfg);
+  auto client = tp == relm::transport::udp
+                ? spawn_datagram_client(system, "localhost", port,
+                                        src_reliability, bcfg)
+                : system.middleman().spawn_client(broker_impl, "localhost",
+                                                  port, src_reliability, bcfg);
+  auto shutdown = [&] {
+    for (auto& x : {src, src_reliability, *server})
+      self->send_exit(x, exit_reason::user_shutdown);
+    for (auto& x : sink_session)
+      self->send_exit(x, exit_reason::user_shutdown);
+  };
+  if (!client) {
+    std::cerr << "failed to spawn client: "
+              << system.render(client.error()) << endl;
+    shutdown();
+    return;
+  }
+  auto start = steady_clock::now();
+  send_as(src_reliability, src, kickoff_atom::value, src_reliability);
+  vector<int64_t> latencies;
+  uint64_t bytes = 0;
+  auto timed_out = false;
+  self->receive(
+    [&](done_atom, vector<int64_t>& xs, uint64_t num_bytes) {
+      latencies = move(xs);
+      bytes = num_bytes;
+    },
+    after(seconds(cfg.timeout_s)) >> [&] {
+      timed_out = true;
+    }
+  );
+  auto elapsed = duration_cast<std::chrono::duration<double>>(
+    steady_clock::now() - start);
+  if (timed_out) {
+    std::cerr << "timed out after " << cfg.timeout_s << "s" << endl;
+    shutdown();
+    return;
+  }
+  uint64_t transmissions = 0;
+  uint64_t retransmissions = 0;
+  self->request(src_reliability, infinite, stats_atom::value).receive(
+    [&](uint64_t num_transmissions, uint64_t num_retransmissions,
+        uint64_t) {
+      transmissions = num_transmissions;
+      retransmissions = num_retransmissions;
+    },
+    [&](error& err) {
+      std::cerr << "failed to query stats: " << system.render(err) << endl;
+    }
+  );
+  double cwnd = 0;
+  double ssthresh = 0;
+  uint64_t loss_events = 0;
+  uint64_t timeouts = 0;
+  self->request(src_reliability, infinite, cc_stats_atom::value).receive(
+    [&](double x, double y, uint64_t num_loss_events, uint64_t num_timeouts) {
+      cwnd = x;
+      ssthresh = y;
+      loss_events = num_loss_events;
+      timeouts = num_timeouts;
+    },
+    [&](error& err) {
+      std::cerr << "failed to query stats: " << system.render(err) << endl;
+    }
+  );
+  uint64_t parity_frames = 0;
+  uint64_t protected_bytes = 0;
+  uint64_t parity_bytes = 0;
+  self->request(src_reliability, infinite, fec_stats_atom::value).receive(
+    [&](uint64_t num_frames, uint64_t num_protected, uint64_t num_parity,
+        uint64_t) {
+      parity_frames = num_frames;
+      protected_bytes = num_protected;
+      parity_bytes = num_parity;
+    },
+    [&](error& err) {
+      std::cerr << "failed to query stats: " << system.render(err) << endl;
+    }
+  );
+  metrics_map metrics;
+  self->request(src_reliability, infinite, metrics_atom::value).receive(
+    [&](metrics_map& xs) {
+      metrics = move(xs);
+    },
+    [&](error& err) {
+      std::cerr << "failed to query metrics: " << system.render(err) << endl;
+    }
+  );
+  if (!cfg.metrics_file.empty()) {
+    ofstream out{cfg.metrics_file, ios::app};
+    if (out)
+      write_metrics(out, global_metrics());
+    else
+      std::cerr << "cannot open " << cfg.metrics_file << endl;
+  }
+  shutdown();
+  sort(latencies.begin(), latencies.end());
+  auto secs = elapsed.count();
+  cout << fixed << setprecision(2)
+       << "messages:        " << cfg.num_messages << " x "
+       << cfg.payload_size << " bytes" << endl
+       << "transport:       " << cfg.transport << endl
+       << "window:          " << cfg.window_size << endl
+       << "impairment seed: " << bcfg.impairment.seed << endl
+       << "elapsed:         " << secs << "s" << endl
+       << "throughput:      " << cfg.num_messages / secs << " msgs/sec" << endl
+       << "goodput:         " << bytes / secs / (1024 * 1024) << " MiB/sec"
+       << endl
+       << "latency p50:     " << percentile(latencies, 0.5) << "us" << endl
+       << "latency p99:     " << percentile(latencies, 0.99) << "us" << endl
+       << "latency p999:    " << percentile(latencies, 0.999) << "us" << endl
+       << "retransmissions: " << retransmissions << " of " << transmissions
+       << " frames ("
+       << (transmissions > 0 ? 100.0 * retransmissions / transmissions : 0.0)
+       << "%)" << endl
+       << "congestion:      " << cfg.congestion << ", cwnd " << cwnd
+       << ", ssthresh " << ssthresh << ", " << loss_events
+       << " loss events, " << timeouts << " timeouts" << endl
+       << "fec:             " << parity_frames << " parity frames, "
+       << (protected_bytes > 0 ? 100.0 * parity_bytes / protected_bytes
+                               : 0.0)
+       << "% bandwidth overhead" << endl
+       << "rtt p50/p99:     " << metrics["rtt_us_p50"] << "us / "
+       << metrics["rtt_us_p99"] << "us" << endl
+       << "bytes on wire:   " << metrics["bytes_sent"] << " sent, "
+       << metrics["bytes_received"] << " received" << endl;
+}
+
+} // namespace anonymous
+
+CAF_MAIN(io::middleman)
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include <caf/all.hpp>
+
+namespace relm {
+
+/// A reference counted byte buffer. Buffers come from a process-wide pool
+/// and return to it with their capacity once the last reference is gone,
+/// which makes filling a recycled buffer free of allocations.
+class pooled_buffer {
+public:
+  pooled_buffer() : rc_(0) {
+    // nop
+  }
+
+  std::vector<char> bytes;
+
+  friend void intrusive_ptr_add_ref(pooled_buffer* x) {
+    x->rc_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  friend void intrusive_ptr_release(pooled_buffer* x);
+
+private:
+  std::atomic<size_t> rc_;
+};
+
+using buffer_ptr = caf::intrusive_ptr<pooled_buffer>;
+
+/// Returns an empty buffer, recycling a released one if possible.
+buffer_ptr make_buffer();
+
+/// Returns the number of buffers the pool had to allocate so far.
+uint64_t pool_allocations();
+
+/// Payload bytes of a message, shared by all copies of the message. Copying
+/// only increments a reference count, the bytes never change once wrapped.
+/// A payload may cover only a part of its buffer, e.g., a fragment of a
+/// larger message.
+class shared_payload {
+public:
+  shared_payload() = default;
+
+  /// Takes ownership of a filled buffer.
+  explicit shared_payload(buffer_ptr buf)
+      : buf_(std::move(buf)),
+        size_(buf_ ? buf_->bytes.size() : 0) {
+    // nop
+  }
+
+  /// Copies `[first, last)` into a pooled buffer.
+  shared_payload(const char* first, const char* last);
+
+  /// Copies `xs` into a pooled buffer.
+  explicit shared_payload(const std::vector<char>& xs)
+      : shared_payload(xs.data(), xs.data() + xs.size()) {
+    // nop
+  }
+
+  const char* data() const {
+    return buf_ ? buf_->bytes.data() + offset_ : nullptr;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size() == 0;
+  }
+
+  const char* begin() const {
+    return data();
+  }
+
+  const char* end() const {
+    return data() + size();
+  }
+
+  /// Returns `n` bytes starting at `offset` without copying them.
+  shared_payload slice(size_t offset, size_t n) const {
+    shared_payload res;
+    res.buf_ = buf_;
+    res.offset_ = offset_ + offset;
+    res.size_ = n;
+    return res;
+  }
+
+  /// Releases the bytes.
+  void clear() {
+    buf_.reset();
+    offset_ = 0;
+    size_ = 0;
+  }
+
+private:
+  buffer_ptr buf_;
+  size_t offset_ = 0;
+  size_t size_ = 0;
+};
+
+// serialized like a `std::vector<char>`, only needed when a message leaves
+// the process
+template <class Inspector>
+typename std::enable_if<Inspector::reads_state,
+                        typename Inspector::result_type>::type
+inspect(Inspector& f, shared_payload& x) {
+  std::vector<char> tmp(x.begin(), x.end());
+  return f(caf::meta::type_name("shared_payload"), tmp);
+}
+
+template <class Inspector>
+typename std::enable_if<Inspector::writes_state,
+                        typename Inspector::result_type>::type
+inspect(Inspector& f, shared_payload& x) {
+  std::vector<char> tmp;
+  auto res = f(caf::meta::type_name("shared_payload"), tmp);
+  x = shared_payload{tmp};
+  return res;
+}
+
+} // namespace relm
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <cstddef>
+
+namespace relm {
+
+/// Available congestion control algorithms.
+enum class congestion_algorithm {
+  /// Only the send window limits the data in flight.
+  none,
+  /// Slow start, additive increase and multiplicative decrease (Reno).
+  aimd,
+  /// Slow start and a cubic window growth function (RFC 8312).
+  cubic
+};
+
+/// Parses "none", "aimd" or "cubic", returns false otherwise.
+bool parse_congestion_algorithm(const std::string& name,
+                                congestion_algorithm& x);
+
+/// Computes the congestion window in frames from the ack and loss signals of
+/// the reliability layer. The reliability layer calls `on_loss` at most once
+/// per window of data and stops calling `on_ack` until the frames in flight
+/// at the time of the loss are acknowledged (fast recovery).
+class congestion_controller {
+public:
+  using clock = std::chrono::steady_clock;
+  using duration = std::chrono::microseconds;
+
+  congestion_controller(double initial_cwnd, double max_cwnd);
+
+  virtual ~congestion_controller();
+
+  /// Called for `acked` frames leaving the network.
+  virtual void on_ack(size_t acked, clock::time_point now, duration srtt) = 0;
+
+  /// Called when selective acks revealed a lost frame.
+  virtual void on_loss(clock::time_point now) = 0;
+
+  /// Called when a retransmission timer fired.
+  virtual void on_timeout(clock::time_point now) = 0;
+
+  virtual const char* name() const = 0;
+
+  /// Returns the number of frames allowed in flight.
+  double cwnd() const {
+    return cwnd_;
+  }
+
+  /// Returns the slow start threshold.
+  double ssthresh() const {
+    return ssthresh_;
+  }
+
+protected:
+  // grows the window by one frame per acked frame until `ssthresh`, returns
+  // the number of acked frames left for congestion avoidance
+  size_t slow_start(size_t acked);
+
+  void clamp();
+
+  double cwnd_;
+  double ssthresh_;
+  double max_cwnd_;
+};
+
+/// Creates a controller for `algorithm` that never exceeds `max_cwnd`.
+std::unique_ptr<congestion_controller>
+make_congestion_controller(congestion_algorithm algorithm, size_t max_cwnd);
+
+} // namespace relm
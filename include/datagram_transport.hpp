@@ -0,0 +1,55 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+#include <caf/all.hpp>
+
+#include "include/framing.hpp"
+#include "include/unreliable_broker.hpp"
+#include "include/reliability_protocol.hpp"
+
+namespace relm {
+
+/// Largest UDP payload over IPv4. A datagram carries up to `batch_size`
+/// whole frames, frames exceeding this size cannot be sent.
+constexpr size_t max_datagram_size = 65507;
+
+/// Largest fragment that fits a datagram together with its header, also as
+/// member of a parity frame.
+constexpr size_t max_datagram_fragment_size = max_datagram_size
+                                              - 2 * max_header_size
+                                              - max_parity_overhead;
+
+/// Available transports between two reliability actors.
+enum class transport {
+  /// Length-prefixed frames on a TCP connection, handled by a CAF broker.
+  tcp,
+  /// Frames in UDP datagrams on a plain socket.
+  udp
+};
+
+/// Parses "tcp" or "udp", returns false otherwise.
+bool parse_transport(const std::string& name, transport& x);
+
+/// Limits `cfg.max_fragment_size` to `max_datagram_fragment_size`, sessions
+/// over UDP require it.
+void fit_to_datagrams(reliability_config& cfg);
+
+/// Binds a UDP socket to `port` and spawns an endpoint for `buddy` that
+/// exchanges frames with the first peer sending to it. Stores the bound port
+/// in `port`, which allows passing 0 to pick a free one.
+caf::expected<caf::actor> spawn_datagram_server(caf::actor_system& sys,
+                                                uint16_t& port,
+                                                const caf::actor& buddy,
+                                                const broker_config& cfg);
+
+/// Spawns an endpoint for `buddy` that exchanges frames with `host:port`.
+caf::expected<caf::actor> spawn_datagram_client(caf::actor_system& sys,
+                                                const std::string& host,
+                                                uint16_t port,
+                                                const caf::actor& buddy,
+                                                const broker_config& cfg);
+
+} // namespace relm
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+#include <unordered_map>
+
+#include "include/framing.hpp"
+#include "include/reliable_msg.hpp"
+
+namespace relm {
+
+// Parity payload, all integers in network byte order:
+//
+//   uint32 count | (uint32 seq | uint32 length)[count] | parity bytes
+//
+// The parity bytes are the XOR of the wire representation of all members
+// without their ack section, each padded with zeros to the longest member.
+
+/// Largest group size, the adaptive mode picks it on a lossless path.
+constexpr size_t max_fec_group_size = 64;
+
+/// Bytes the payload of a parity frame adds to its largest member, i.e., the
+/// member count plus sequence number and size of each member.
+constexpr size_t max_parity_overhead =
+  sizeof(uint32_t) + max_fec_group_size * (sizeof(seq_num) + sizeof(uint32_t));
+
+/// Tunables of the forward error correction.
+struct fec_config {
+  /// Data frames per parity frame, zero disables FEC.
+  size_t group_size = 0;
+  /// Derives the group size from the share of retransmitted frames.
+  bool adaptive = false;
+};
+
+/// Returns a group size for the loss rate `p` that keeps the expected number
+/// of losses per group below one, since a parity frame repairs one loss.
+size_t adapt_fec_group_size(double p);
+
+/// Collects outgoing data frames into groups and computes an XOR parity
+/// frame for each complete group.
+class fec_encoder {
+public:
+  explicit fec_encoder(size_t group_size = 0);
+
+  size_t group_size() const {
+    return group_size_;
+  }
+
+  /// Changes the group size, applies to the open group as well. Zero
+  /// disables the encoder, sizes above `max_fec_group_size` select it.
+  void group_size(size_t n) {
+    group_size_ = std::min(n, max_fec_group_size);
+  }
+
+  /// Adds `msg` to the current group. Returns true and stores the parity
+  /// frame in `parity` if this completed the group.
+  bool add(reliable_msg& msg, reliable_msg& parity);
+
+  /// Returns the number of protected bytes.
+  uint64_t protected_bytes() const {
+    return protected_bytes_;
+  }
+
+  /// Returns the number of parity bytes.
+  uint64_t parity_bytes() const {
+    return parity_bytes_;
+  }
+
+private:
+  size_t group_size_;
+  std::vector<std::pair<seq_num, uint32_t>> members_;
+  byte_buffer parity_;
+  byte_buffer scratch_;
+  uint64_t protected_bytes_;
+  uint64_t parity_bytes_;
+};
+
+/// Remembers recently received data frames and restores a single missing
+/// member of a group from its parity frame.
+class fec_decoder {
+public:
+  /// Remembers up to `history` frames.
+  explicit fec_decoder(size_t history = 4 * max_fec_group_size);
+
+  /// Remembers the data frame `msg`.
+  void add(reliable_msg& msg);
+
+  /// Restores the member of the group of `parity` that did not arrive.
+  /// Returns false if all or more than one of them are missing.
+  bool recover(const reliable_msg& parity, reliable_msg& res);
+
+private:
+  size_t history_;
+  std::unordered_map<seq_num, byte_buffer> frames_;
+  std::deque<seq_num> order_;
+  byte_buffer scratch_;
+};
+
+} // namespace relm
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <type_traits>
+
+#include "include/reliable_msg.hpp"
+
+namespace relm {
+
+using byte_buffer = std::vector<char>;
+
+// Frame layout, fixed-size integers in network byte order, varints in LEB128
+// (7 bits per byte, least significant group first, at most 5 bytes):
+//
+//   header:      uint8 version << 2 | type | varint flags | varint length
+//                | uint24 seq
+//   has_acks:    uint24 ack | varint window | varint num_sacks
+//                | (varint gap | varint span)[num_sacks]
+//   has_payload: varint stream [| varint seq - stream_seq] | uint8 atom code
+//                [| uint64 atm]
+//                [| varint index | varint offset | varint message_size]
+//                | payload bytes until the end of the frame
+//
+// `seq` and `ack` are the low `seq_bits` bits of the sequence numbers, the
+// receiver restores the rest from its windows, see `restore_seqs`. A SACK
+// range starts `gap` frames after the end of the previous range, the first
+// one after `ack`, and ends `span` frames after its start. Unordered frames
+// omit the distance between `seq` and `stream_seq`. Only atom code 0 is
+// followed by the atom itself, the fragment fields are only present with
+// the `fragment` flag. `length` counts the bytes following it.
+
+/// Version of the frame format written by this implementation.
+constexpr uint8_t frame_version = 7;
+
+/// Number of low bits of a sequence number on the wire.
+constexpr unsigned seq_bits = 24;
+
+/// Upper bound for the `length` field, larger frames are malformed.
+constexpr uint32_t max_frame_length = 1024 * 1024;
+
+/// Upper bound for the SACK ranges of a frame. Acks report the ranges closest
+/// to the cumulative ack, later ones follow once the gaps below them closed.
+constexpr size_t max_sack_ranges = 64;
+
+/// Upper bound for the bytes of a frame in front of its payload, i.e., any
+/// payload of up to `max_frame_length - max_header_size` bytes fits a frame.
+constexpr size_t max_header_size =
+  1 + 2 * 3                                // type, flags, length
+  + 2 * (seq_bits / 8) + 2 * 5             // seq, ack, window, num_sacks
+  + max_sack_ranges * 2 * 5                // gap and span per SACK range
+  + 5 * 5 + 1 + sizeof(uint64_t);          // stream, fragment fields, atom
+
+/// Number of bytes the broker requests per read from a connection.
+constexpr size_t max_read_size = 64 * 1024;
+
+// utility function for appending an integer type to a buffer
+template <class T>
+size_t write_int(byte_buffer& buf, T value) {
+  using unsigned_type = typename std::make_unsigned<T>::type;
+  auto x = static_cast<unsigned_type>(value);
+  auto pos = buf.size();
+  buf.resize(pos + sizeof(T));
+  for (size_t i = 0; i < sizeof(T); ++i)
+    buf[pos + i] = static_cast<char>((x >> ((sizeof(T) - 1 - i) * 8)) & 0xFF);
+  return sizeof(T);
+}
+
+// utility function for reading an integer from incoming data
+template <class T>
+size_t read_int(const char* data, T& storage) {
+  using unsigned_type = typename std::make_unsigned<T>::type;
+  unsigned_type x = 0;
+  for (size_t i = 0; i < sizeof(T); ++i)
+    x = static_cast<unsigned_type>((x << 8)
+                                   | static_cast<unsigned char>(data[i]));
+  storage = static_cast<T>(x);
+  return sizeof(T);
+}
+
+/// Appends `x` as a varint to `buf`, returns the number of written bytes.
+size_t write_varint(byte_buffer& buf, uint32_t x);
+
+/// Returns the number of bytes `write_varint` writes for `x`.
+inline size_t varint_size(uint32_t x) {
+  size_t res = 1;
+  for (; x >= 0x80; x >>= 7)
+    ++res;
+  return res;
+}
+
+/// A frame decoded in place. All pointers refer to the buffer it was
+/// decoded from and become invalid with it. Sequence numbers hold only the
+/// bits sent on the wire until `restore_seqs` completes them.
+struct frame_view {
+  uint8_t version;
+  frame_type type;
+  uint16_t flags;
+  /// Bytes up to and including the `length` field.
+  size_t header_size;
+  uint32_t length;
+  seq_num seq;
+  // ack section
+  seq_num ack_seq;
+  uint32_t window;
+  uint32_t num_sacks;
+  const char* sacks;
+  // payload section
+  uint16_t stream;
+  seq_num stream_seq;
+  caf::atom_value atm;
+  // fragment section
+  uint32_t fragment_index;
+  uint32_t fragment_offset;
+  uint32_t message_size;
+  const char* payload;
+  size_t payload_size;
+
+  bool has(frame_flags flag) const {
+    return (flags & flag) != 0;
+  }
+
+  /// Returns the number of bytes the frame occupies in its buffer.
+  size_t size() const {
+    return header_size + length;
+  }
+
+  /// Copies the frame into an owning message.
+  reliable_msg to_msg() const;
+};
+
+enum class decode_status {
+  complete,
+  incomplete,
+  malformed
+};
+
+/// Returns the number of bytes `encode` writes for `msg`.
+size_t encoded_size(const reliable_msg& msg);
+
+/// Appends the wire representation of `msg` to `buf`. Writing several
+/// messages into the same buffer before flushing it batches them.
+size_t encode(byte_buffer& buf, const reliable_msg& msg);
+
+/// Appends the wire representation of `msg` without its payload bytes to
+/// `buf` for writing the payload straight from its buffer, e.g., as the
+/// next element of a scatter-gather write. Returns the number of bytes
+/// written to `buf`.
+size_t encode_header(byte_buffer& buf, const reliable_msg& msg);
+
+/// Decodes the first frame in `[data, data + size)` without copying it.
+/// Returns `incomplete` if the buffer ends before the frame does.
+decode_status decode(const char* data, size_t size, frame_view& x);
+
+/// Completes the sequence numbers of a decoded frame: `seq` and
+/// `stream_seq` become the values closest to `seq_ref`, `ack_seq` and the
+/// SACK ranges the values closest to `ack_ref`. The receiver passes the
+/// next expected frame and the next frame it sends. Leaves complete
+/// sequence numbers close to the references unchanged.
+void restore_seqs(reliable_msg& msg, seq_num seq_ref, seq_num ack_ref);
+
+/// Decodes all complete frames in `[data, data + size)` and calls `f` for
+/// each one. Stores the number of bytes belonging to complete frames in
+/// `consumed`. Returns `malformed` if decoding stopped at a broken frame.
+template <class F>
+decode_status decode_all(const char* data, size_t size, size_t& consumed,
+                         F f) {
+  consumed = 0;
+  frame_view x;
+  for (;;) {
+    auto res = decode(data + consumed, size - consumed, x);
+    if (res != decode_status::complete)
+      return res;
+    f(x);
+    consumed += x.size();
+  }
+}
+
+} // namespace relm
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <cstdint>
+
+namespace relm {
+
+/// Decides which frames are lost.
+enum class loss_model {
+  /// Every frame is lost independently with `loss_rate`.
+  bernoulli,
+  /// Two-state Markov chain that alternates between a good and a bad state
+  /// with separate loss rates, producing bursts of losses.
+  gilbert_elliott
+};
+
+/// Distribution of the artificial delay added to frames.
+enum class delay_model {
+  /// Every frame is delayed by `delay`.
+  constant,
+  /// Frames are delayed by a geometrically distributed multiple of `delay`
+  /// (p = 0.5), i.e., half of them arrive without delay.
+  geometric,
+  /// Frames are delayed uniformly between zero and twice `delay`.
+  uniform
+};
+
+/// Parses "bernoulli" or "gilbert-elliott", returns false otherwise.
+bool parse_loss_model(const std::string& name, loss_model& x);
+
+/// Parses "constant", "geometric" or "uniform", returns false otherwise.
+bool parse_delay_model(const std::string& name, delay_model& x);
+
+/// Parameters of the simulated network between two brokers.
+struct impairment_config {
+  /// Seed of the random number generator. Two stages with the same seed
+  /// treat the n-th frame they see the same way.
+  uint64_t seed = 0;
+  loss_model losses = loss_model::bernoulli;
+  /// Probability of dropping a frame with `loss_model::bernoulli`.
+  double loss_rate = 0.10;
+  /// Probability of moving from the good to the bad state per frame.
+  double ge_p = 0.01;
+  /// Probability of moving from the bad to the good state per frame.
+  double ge_r = 0.25;
+  /// Loss rate in the good state.
+  double ge_loss_good = 0.0;
+  /// Loss rate in the bad state.
+  double ge_loss_bad = 1.0;
+  /// Scale of the artificial delay, zero disables it.
+  std::chrono::milliseconds delay{500};
+  delay_model delays = delay_model::geometric;
+  /// Probability of holding a frame back by `reorder_delay` so that
+  /// subsequent frames overtake it.
+  double reorder_rate = 0.0;
+  std::chrono::milliseconds reorder_delay{10};
+  /// Probability of delivering a frame twice.
+  double duplicate_rate = 0.0;
+  /// Link capacity in bytes per second, zero means unlimited.
+  uint64_t bandwidth = 0;
+};
+
+/// Applies loss, delay, reordering, duplication and a bandwidth cap to the
+/// frames of one connection. The fate of each frame depends only on the seed
+/// and the number of frames seen before, the arrival time only matters for
+/// the bandwidth cap.
+class impairment {
+public:
+  using duration = std::chrono::microseconds;
+  using clock = std::chrono::steady_clock;
+
+  /// Delivery plan for a single frame.
+  struct verdict {
+    /// Number of copies to deliver, 0 if the frame is lost.
+    size_t copies;
+    /// Delay for each copy.
+    duration delays[2];
+    bool reordered;
+  };
+
+  explicit impairment(const impairment_config& cfg);
+
+  impairment();
+
+  /// Decides the fate of a frame of `size` bytes arriving at `now`.
+  verdict apply(clock::time_point now, size_t size);
+
+  const impairment_config& config() const {
+    return cfg_;
+  }
+
+  uint64_t frames() const {
+    return frames_;
+  }
+
+  uint64_t lost() const {
+    return lost_;
+  }
+
+  uint64_t duplicated() const {
+    return duplicated_;
+  }
+
+  uint64_t reordered() const {
+    return reordered_;
+  }
+
+private:
+  duration sample_delay(double x);
+
+  impairment_config cfg_;
+  std::mt19937_64 gen_;
+  std::uniform_real_distribution<double> unit_;
+  bool bad_state_;
+  // time at which the simulated link finished sending the last frame
+  clock::time_point link_free_;
+  uint64_t frames_;
+  uint64_t lost_;
+  uint64_t duplicated_;
+  uint64_t reordered_;
+};
+
+} // namespace relm
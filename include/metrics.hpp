@@ -0,0 +1,140 @@
+#pragma once
+
+#include <map>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+#include <caf/all.hpp>
+
+namespace relm {
+
+using metrics_atom = caf::atom_constant<caf::atom("metrics")>;
+using dump_atom    = caf::atom_constant<caf::atom("dump")>;
+
+/// Metric names and values, histograms appear as several entries.
+using metrics_map = std::map<std::string, uint64_t>;
+
+/// A counter written by a single owner and read from any thread. Updates are
+/// a relaxed load and store without a locked instruction.
+class counter {
+public:
+  counter() : value_(0) {
+    // nop
+  }
+
+  void add(uint64_t n = 1) {
+    value_.store(value_.load(std::memory_order_relaxed) + n,
+                 std::memory_order_relaxed);
+  }
+
+  uint64_t get() const {
+    return value_.load(std::memory_order_relaxed);
+  }
+
+private:
+  std::atomic<uint64_t> value_;
+};
+
+/// A value sampled by a single owner and read from any thread.
+class gauge {
+public:
+  gauge() : value_(0) {
+    // nop
+  }
+
+  void set(uint64_t x) {
+    value_.store(x, std::memory_order_relaxed);
+  }
+
+  uint64_t get() const {
+    return value_.load(std::memory_order_relaxed);
+  }
+
+private:
+  std::atomic<uint64_t> value_;
+};
+
+/// A log-linear histogram in the style of HdrHistogram: each power of two is
+/// split into 16 buckets, which bounds the relative error to 1/16. Recording
+/// is a few bit operations and a counter update, written by a single owner.
+class histogram {
+public:
+  static constexpr size_t sub_bucket_bits = 4;
+  static constexpr size_t num_buckets = (64 - sub_bucket_bits + 1)
+                                        << sub_bucket_bits;
+
+  histogram();
+
+  void record(uint64_t x) {
+    buckets_[index(x)].add();
+  }
+
+  /// Adds the bucket counts to `xs`, which has `num_buckets` elements.
+  void add_to(std::vector<uint64_t>& xs) const;
+
+  /// Returns the bucket of `x`.
+  static size_t index(uint64_t x);
+
+  /// Returns the smallest value in bucket `i`.
+  static uint64_t lowest(size_t i);
+
+private:
+  std::vector<counter> buckets_;
+};
+
+/// Adds the count, percentiles and maximum of the bucket counts `xs` as
+/// `<name>_count`, `<name>_p50`, ... to `res`.
+void export_histogram(const std::string& name,
+                      const std::vector<uint64_t>& xs, metrics_map& res);
+
+/// Metrics of one session, recorded by its reliability actor. Counts all
+/// frames, times are in microseconds. Each session registers itself for
+/// the process-wide metrics while alive.
+struct session_metrics {
+  session_metrics();
+
+  ~session_metrics();
+
+  session_metrics(const session_metrics&) = delete;
+  session_metrics& operator=(const session_metrics&) = delete;
+
+  counter data_sent;       // first transmissions of data frames
+  counter retransmitted;   // data frames sent again
+  counter data_received;   // including duplicates
+  counter duplicates;      // data frames received before
+  counter out_of_order;    // data frames arriving after a gap
+  counter acks_sent;       // standalone acks
+  counter acks_received;   // frames carrying acks
+  counter bytes_sent;      // encoded frames, all types
+  counter bytes_received;  // ... and on the receiving side
+  gauge outbox;            // frames in flight
+  gauge inbox;             // sequence numbers received above the ack
+  gauge ready;             // frames awaiting delivery credit
+  gauge output;            // frames held back by the output scheduler
+  histogram rtt;           // round trip time samples
+  histogram ack_delay;     // receipt of a frame until the ack goes out
+
+  /// Returns the metrics of this session.
+  metrics_map snapshot() const;
+};
+
+/// Returns the metrics of all sessions in the process, including finished
+/// ones. Gauges only cover running sessions.
+metrics_map global_metrics();
+
+/// Writes `xs` as a block of `name value` lines after a `# <unix time ms>`
+/// header line.
+void write_metrics(std::ostream& out, const metrics_map& xs);
+
+/// Appends the process-wide metrics to the file at `path` every `interval`
+/// and answers `metrics_atom` with them. A zero interval disables the dump.
+caf::behavior metrics_exporter(caf::event_based_actor* self,
+                               const std::string& path,
+                               std::chrono::milliseconds interval);
+
+} // namespace relm
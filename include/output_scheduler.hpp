@@ -0,0 +1,104 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "include/ring_queue.hpp"
+#include "include/reliable_msg.hpp"
+
+namespace relm {
+
+/// Classes of outgoing frames, in order of precedence.
+enum class traffic_class : uint8_t {
+  control,     // standalone acks
+  retransmit,  // data frames sent before
+  data         // first transmissions and their parity frames
+};
+
+constexpr size_t num_traffic_classes = 3;
+
+/// Holds outgoing frames back while the host has `max_pending_bytes` or more
+/// in its write queue and releases them by class: control frames before
+/// retransmissions before new data, in FIFO order within a class. The host
+/// reports the bytes leaving its queue via `written`. A limit of zero
+/// releases every frame right away.
+class output_scheduler {
+public:
+  explicit output_scheduler(size_t max_pending_bytes = 0);
+
+  /// Queues `msg` behind all frames of the same class.
+  void push(traffic_class cls, reliable_msg msg);
+
+  /// Takes `n` bytes off the pending bytes.
+  void written(size_t n);
+
+  /// Returns the number of queued frames of `cls`.
+  size_t queued(traffic_class cls) const {
+    return queues_[static_cast<size_t>(cls)].size();
+  }
+
+  /// Returns the number of queued frames of all classes.
+  size_t size() const;
+
+  bool empty() const {
+    return size() == 0;
+  }
+
+  /// Returns the bytes handed to the host but not written yet.
+  size_t pending_bytes() const {
+    return pending_;
+  }
+
+  size_t max_pending_bytes() const {
+    return max_pending_;
+  }
+
+  /// Releases frames by precedence while the pending bytes are below the
+  /// limit. Calls `f(cls, msg)` for each released frame, which returns the
+  /// bytes it handed to the host or zero for a frame it dropped. A frame
+  /// may exceed the limit on its own. Calls from within `f` return
+  /// immediately, `f` may call `push` and `written`.
+  template <class F>
+  void drain(F f) {
+    if (draining_)
+      return;
+    draining_ = true;
+    size_t i = 0;
+    while (i < num_traffic_classes && !full()) {
+      auto& queue = queues_[i];
+      if (queue.empty()) {
+        ++i;
+        continue;
+      }
+      auto msg = std::move(queue.front());
+      queue.pop_front();
+      pending_ += f(static_cast<traffic_class>(i), msg);
+      // bytes reported by `f` may include the frame it just released
+      if (written_while_draining_ > 0) {
+        take_off(written_while_draining_);
+        written_while_draining_ = 0;
+      }
+      // `f` may have queued frames of a higher class
+      i = 0;
+    }
+    draining_ = false;
+  }
+
+private:
+  bool full() const {
+    return max_pending_ > 0 && pending_ >= max_pending_;
+  }
+
+  void take_off(size_t n) {
+    pending_ = n < pending_ ? pending_ - n : 0;
+  }
+
+  std::array<ring_queue<reliable_msg>, num_traffic_classes> queues_;
+  size_t max_pending_;
+  size_t pending_;
+  size_t written_while_draining_;
+  bool draining_;
+};
+
+} // namespace relm
@@ -1,48 +1,141 @@
 #pragma once
 
-#include <tuple>
+#include <chrono>
+#include <string>
 #include <vector>
+#include <utility>
+#include <functional>
 
 #include <caf/all.hpp>
 
-#include "include/reliable_msg.hpp"
+#include "include/reliability_protocol.hpp"
 
 namespace relm {
 
-using retransmit_cnt = int32_t;
-using clk            = std::chrono::high_resolution_clock;
-using tp             = clk::time_point;
-
 using send_atom      = caf::atom_constant<caf::atom("send")>;
 using recv_atom      = caf::atom_constant<caf::atom("receive")>;
 using register_atom  = caf::atom_constant<caf::atom("register")>;
 using send_acks_atom = caf::atom_constant<caf::atom("send_acks")>;
+using tick_atom      = caf::atom_constant<caf::atom("tick")>;
+using pause_atom     = caf::atom_constant<caf::atom("pause")>;
+using resume_atom    = caf::atom_constant<caf::atom("resume")>;
+using stats_atom     = caf::atom_constant<caf::atom("stats")>;
+using cc_stats_atom  = caf::atom_constant<caf::atom("cc_stats")>;
+using credit_atom    = caf::atom_constant<caf::atom("credit")>;
+using stream_atom    = caf::atom_constant<caf::atom("stream")>;
+using fec_atom       = caf::atom_constant<caf::atom("fec")>;
+using fec_stats_atom = caf::atom_constant<caf::atom("fec_stats")>;
+using batch_atom     = caf::atom_constant<caf::atom("batch")>;
+using written_atom   = caf::atom_constant<caf::atom("written")>;
 
-struct reliability_state {
-  int16_t unacked = 0;
-  int32_t seq_send = 0; // next sequence number to send
-  int32_t seq_recv = 0; // next sequence number to receive
-  std::vector<reliable_msg> inbox;   // missing previous seq
-  std::vector<reliable_msg> outbox;  // requires acks from dest
+struct reliability_actor_state {
+  reliability_protocol protocol;
   std::string name = "reliability_actor";
 };
 
-reliable_msg create_ack_msg(reliability_state& state);
+/// Sends `msg` from `self` to the application after `delay`.
+template <class Self>
+void deliver(Self* self, const caf::actor& app, const reliable_msg& msg,
+             std::chrono::milliseconds delay) {
+  if (delay.count() == 0) {
+    if (msg.has(scalar_payload))
+      self->send(app, msg.atm, msg.content());
+    else
+      self->send(app, msg.atm, msg.payload);
+  } else if (msg.has(scalar_payload)) {
+    self->delayed_send(app, delay, msg.atm, msg.content());
+  } else {
+    self->delayed_send(app, delay, msg.atm, msg.payload);
+  }
+}
+
+/// Hooks of a protocol run by `self`: frames go to `write`, messages to the
+/// application `app` and timers arrive as `tick_atom` and `send_acks_atom`.
+template <class Self>
+protocol_hooks
+actor_hooks(Self* self, const caf::actor& app,
+            std::function<void (const reliable_msg&)> write) {
+  protocol_hooks hooks;
+  hooks.write = std::move(write);
+  hooks.deliver = [=](const reliable_msg& msg,
+                      std::chrono::milliseconds delay) {
+    deliver(self, app, msg, delay);
+  };
+  hooks.deliver_batch = [=](std::vector<reliable_msg> batch,
+                            std::chrono::milliseconds delay) {
+    if (delay.count() == 0)
+      self->send(app, batch_atom::value, std::move(batch));
+    else
+      self->delayed_send(app, delay, batch_atom::value, std::move(batch));
+  };
+  hooks.backpressure = [=](bool paused) {
+    if (paused)
+      self->send(app, pause_atom::value);
+    else
+      self->send(app, resume_atom::value);
+  };
+  hooks.schedule = [=](protocol_timer timer,
+                       std::chrono::milliseconds delay) {
+    if (timer == protocol_timer::tick)
+      self->delayed_send(self, delay, tick_atom::value);
+    else
+      self->delayed_send(self, delay, send_acks_atom::value);
+  };
+  return hooks;
+}
 
-std::vector<reliable_msg>::iterator find_seq(std::vector<reliable_msg>& vec,
-                                             const int32_t seq);
+/// Handles the messages of the application, the protocol timers and the
+/// stats queries by calling `p`, which must outlive the handler. Shared by
+/// the reliability actor and the fused broker.
+caf::message_handler protocol_handlers(reliability_protocol* p);
 
 /// Actor doesn't know the broker yet, waiting to be initialized
-caf::behavior init_reliability_actor(caf::stateful_actor<reliability_state>* self,
-                                     const caf::actor& app);
+caf::behavior
+init_reliability_actor(caf::stateful_actor<reliability_actor_state>* self,
+                       const caf::actor& app, const reliability_config& cfg);
 
 /// Actor know the application and the broker, working state
 /// Functionality:
 /// - retransmit / ack
-/// - ordering
-/// - missing: duplicate packet detection
-caf::behavior reliability_actor(caf::stateful_actor<reliability_state>* self,
-                                const caf::actor& app,
-                                const caf::actor& broker);
+/// - ordering within independent streams: messages sent as
+///   `(stream_atom, uint16_t, atom_value, shared_payload)` share acks and
+///   congestion state with all other messages but are only ordered with
+///   respect to the same stream, all other messages use stream 0
+/// - delivery policies per application atom: reliable and ordered,
+///   reliable and unordered, or partially reliable, where the sender
+///   abandons a message after its lifetime or a number of transmissions and
+///   sends a marker without payload in its place so the receiver skips it
+/// - delivers each message as `(atom_value, payload)` or, with
+///   `batch_delivery`, all messages that became deliverable at once as
+///   `(batch_atom, std::vector<reliable_msg>)`
+/// - back-pressure: sends `pause_atom` to the application when the outbox is
+///   full and `resume_atom` once all held back messages were sent
+/// - duplicate packet detection
+/// - flow control: acks advertise the receive window, the sender does not
+///   exceed the window of its peer, and the application may pace delivery by
+///   granting credit via `(credit_atom, uint32_t)`
+/// - piggybacks acks on outgoing data, standalone acks only after
+///   `ack_delay` without reverse traffic
+/// - output scheduling: stops sending to the broker once it holds
+///   `max_pending_bytes` not yet written, the broker reports written bytes
+///   via `(written_atom, uint64_t)`; held back frames leave in the order
+///   standalone acks, retransmissions, new data
+/// - congestion control, frames in flight are limited by the window of a
+///   pluggable congestion controller
+/// - answers `stats_atom` with the number of transmitted and retransmitted
+///   data frames and standalone acks
+/// - answers `cc_stats_atom` with the congestion window, slow start
+///   threshold, loss events and timeouts
+/// - forward error correction: sends an XOR parity frame per group of data
+///   frames and restores a single lost frame per group without waiting for
+///   a retransmission, `(fec_atom, uint32_t)` sets the group size at runtime
+///   (0 disables FEC) and stops adapting it to the share of retransmitted
+///   frames
+/// - answers `fec_stats_atom` with the parity frames sent, the protected and
+///   the parity bytes, and the frames restored from parity
+/// - answers `metrics_atom` with the metrics of this session
+caf::behavior
+reliability_actor(caf::stateful_actor<reliability_actor_state>* self,
+                  const caf::actor& app, const caf::actor& broker);
 
 } // namespace relm
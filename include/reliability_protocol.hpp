@@ -0,0 +1,261 @@
+#pragma once
+
+#include <map>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+
+#include <caf/all.hpp>
+
+#include "include/fec.hpp"
+#include "include/framing.hpp"
+#include "include/metrics.hpp"
+#include "include/congestion.hpp"
+#include "include/send_window.hpp"
+#include "include/output_scheduler.hpp"
+#include "include/reorder_buffer.hpp"
+#include "include/timer_wheel.hpp"
+#include "include/ring_queue.hpp"
+#include "include/rto_estimator.hpp"
+#include "include/reliable_msg.hpp"
+
+namespace relm {
+
+using retransmit_cnt = int32_t;
+using clk            = std::chrono::high_resolution_clock;
+using tp             = clk::time_point;
+
+/// Upper bound for `reliability_config::window_size`. Frames carry only the
+/// low `seq_bits` bits of their sequence numbers, the receiver restores them
+/// relative to its window and tolerates duplicates delayed by up to
+/// 2^(seq_bits - 1) - 2 * `max_window_size` frames.
+constexpr size_t max_window_size = size_t{1} << (seq_bits - 4);
+
+/// Delivery guarantees for a class of messages. The defaults retransmit a
+/// message until it is acked and deliver it in stream order, a limit on the
+/// lifetime or the transmissions makes it partially reliable.
+struct delivery_policy {
+  /// Delivers messages in stream order. Unordered messages skip the reorder
+  /// stage and reach the application as soon as they arrive.
+  bool ordered = true;
+  /// Abandons a message this long after its first transmission. Zero
+  /// disables the limit.
+  std::chrono::milliseconds lifetime{0};
+  /// Abandons a message after this many transmissions. Zero disables the
+  /// limit.
+  uint32_t max_transmissions = 0;
+};
+
+/// Tunables of the reliability layer.
+struct reliability_config {
+  /// Maximum number of unacknowledged frames in flight, also bounds the
+  /// number of frames buffered for reordering. At most `max_window_size`.
+  size_t window_size = 1024;
+  /// Retransmission timeout before the first RTT sample.
+  std::chrono::milliseconds initial_rto{1000};
+  /// Lower bound for the retransmission timeout.
+  std::chrono::milliseconds min_rto{200};
+  /// Upper bound for the retransmission timeout, including backoff.
+  std::chrono::milliseconds max_rto{60000};
+  /// Holds messages back this long before handing them to the application.
+  std::chrono::milliseconds delivery_delay{0};
+  /// Hands all messages that became deliverable at once to the application
+  /// as a single `(batch_atom, std::vector<reliable_msg>)` message instead
+  /// of one message each.
+  bool batch_delivery = false;
+  /// Time a received frame waits for outgoing data to carry its ack before
+  /// a standalone ack is sent. Zero acks immediately.
+  std::chrono::milliseconds ack_delay{20};
+  /// Algorithm limiting the frames in flight below `window_size`.
+  congestion_algorithm congestion = congestion_algorithm::aimd;
+  /// Number of messages delivered before the application has to grant more
+  /// via `(credit_atom, uint32_t)`. Zero disables credit-based delivery.
+  uint32_t initial_credit = 0;
+  /// Delivery policies by application atom, all other messages use the
+  /// default policy.
+  std::map<caf::atom_value, delivery_policy> policies;
+  /// Parity frames for outgoing data, disabled by default.
+  fec_config fec;
+  /// Splits larger payloads into fragments of this many bytes, each one
+  /// sent, acked and retransmitted as a frame of its own. The receiver
+  /// delivers the message once all of its fragments arrived. Fragmented
+  /// messages ignore the lifetime and transmission limits of their policy.
+  /// Payloads above the largest frame are always fragmented, zero or any
+  /// larger value splits them at that limit only.
+  size_t max_fragment_size = 1400;
+  /// Largest message the receiver reassembles from fragments, also the
+  /// memory incomplete messages may take. Fragments of larger messages are
+  /// refused like frames beyond the window, both endpoints must agree on it.
+  size_t max_message_size = 64 * 1024 * 1024;
+  /// Holds frames back once this many bytes went to the host without being
+  /// written, so acks and retransmissions can overtake new data queued
+  /// behind them. Zero writes every frame right away.
+  size_t max_pending_bytes = 64 * 1024;
+  /// Sequence number of the first frame and of the first message in each
+  /// stream, both endpoints must agree on it. Values close to 2^32 let a
+  /// session cross the wrap-around of sequence numbers early on.
+  seq_num initial_seq = 0;
+};
+
+/// Fragments received for an incomplete message.
+struct partial_message {
+  buffer_ptr buf;       // the whole message, filled as fragments arrive
+  size_t received = 0;  // payload bytes received so far
+};
+
+struct reliability_state {
+  size_t unacked = 0;
+  reorder_buffer inbox;              // received seqs above the cumulative ack
+  // per stream: frames missing a previous frame of the same stream
+  std::unordered_map<uint16_t, reorder_buffer> stream_inboxes;
+  ring_queue<reliable_msg> ready;    // in order, waiting for credit
+  // incomplete messages by the seq of their first fragment
+  std::unordered_map<seq_num, partial_message> reassembly;
+  size_t reassembly_bytes = 0;       // buffers of incomplete messages
+  size_t max_fragment_size = 0;
+  size_t max_message_size = 0;
+  uint64_t credit = 0;               // messages the app accepts
+  bool unlimited_credit = true;
+  uint32_t advertised = 0;           // receive window in our last ack
+  seq_num peer_ack = 0;              // latest cumulative ack of the peer
+  seq_num peer_limit = 0;            // highest seq the peer accepts
+  send_window outbox;                // requires acks from dest
+  // per stream: position of the next frame
+  std::unordered_map<uint16_t, seq_num> stream_seqs;
+  seq_num initial_seq = 0;           // first seq of the session and streams
+  ring_queue<reliable_msg> backlog;  // waiting for space in the outbox
+  output_scheduler output;           // frames waiting for the host
+  std::map<caf::atom_value, delivery_policy> policies;
+  timer_wheel retransmits;           // pending timeouts for the outbox
+  rto_estimator rtt;                 // RTT statistics and current RTO
+  std::unique_ptr<congestion_controller> cc;
+  seq_num recover = 0;               // highest seq sent at the last loss
+  bool in_recovery = false;          // cwnd frozen until `recover` is acked
+  uint64_t loss_events = 0;          // window reductions after SACKs ...
+  uint64_t timeouts = 0;             // ... and after timeouts
+  std::chrono::milliseconds delivery_delay{0};
+  bool batch_delivery = false;
+  std::chrono::milliseconds ack_delay{0};
+  bool ack_timer_set = false;        // a delayed ack is pending
+  bool ack_pending = false;          // received data not acked yet ...
+  tp ack_pending_since;              // ... since this time
+  uint64_t abandonments = 0;         // partially reliable frames given up
+  fec_encoder fec_out;               // parity for outgoing data frames
+  fec_decoder fec_in;                // repairs incoming data frames
+  bool fec_active = false;           // the peer sent parity frames
+  bool fec_adaptive = false;
+  uint64_t fec_transmissions = 0;    // transmissions at the last adaption
+  uint64_t fec_retransmissions = 0;  // ... and retransmissions
+  uint64_t parity_frames = 0;        // parity frames put on the wire
+  uint64_t recovered = 0;            // data frames restored from parity
+  session_metrics metrics;
+};
+
+reliable_msg create_ack_msg(reliability_state& state);
+
+/// Returns the number of frames after the cumulative ack we can buffer, i.e.,
+/// the free slots of the reorder buffer minus frames awaiting credit.
+uint32_t receive_window(const reliability_state& state);
+
+/// Adds the current cumulative ack and SACK ranges to an outgoing frame.
+void piggyback_acks(reliability_state& state, reliable_msg& msg);
+
+/// Timers a protocol asks its host to fire.
+enum class protocol_timer {
+  tick,  // drives retransmissions, calls `tick()`
+  ack    // delayed standalone ack, calls `ack_timeout()`
+};
+
+/// Connects a protocol to its host, i.e., the actor or broker running it.
+/// The protocol calls them from within its member functions only.
+struct protocol_hooks {
+  /// Puts a frame on the wire. The host reports the bytes leaving its write
+  /// queue via `reliability_protocol::written`.
+  std::function<void (const reliable_msg&)> write;
+  /// Hands an in-order message to the application after a delay.
+  std::function<void (const reliable_msg&, std::chrono::milliseconds)>
+    deliver;
+  /// Hands several in-order messages to the application at once after a
+  /// delay, used with `batch_delivery`.
+  std::function<void (std::vector<reliable_msg>, std::chrono::milliseconds)>
+    deliver_batch;
+  /// Tells the application to stop (`true`) or resume (`false`) sending.
+  std::function<void (bool)> backpressure;
+  /// Calls the member function matching the timer after a delay.
+  std::function<void (protocol_timer, std::chrono::milliseconds)> schedule;
+};
+
+/// The reliability state machine as a plain object without mailbox. The
+/// reliability actor runs one per session behind its own mailbox, a fused
+/// broker calls it directly from its I/O handlers instead.
+class reliability_protocol {
+public:
+  reliability_protocol() = default;
+
+  reliability_protocol(const reliability_protocol&) = delete;
+  reliability_protocol& operator=(const reliability_protocol&) = delete;
+
+  /// Applies the tunables, must precede `start`.
+  void init(const reliability_config& cfg);
+
+  /// Connects the protocol to its host and arms the first tick. `id` tags
+  /// trace events of this session.
+  void start(protocol_hooks hooks, caf::actor_id id);
+
+  /// Sends a message of the application, holding it back while the windows
+  /// are full. Splits payloads above `max_fragment_size` into fragments
+  /// that share the buffer of the message.
+  void send(reliable_msg msg);
+
+  /// Processes a frame from the wire.
+  void receive(reliable_msg& msg);
+
+  /// Processes the acks of a frame.
+  void handle_ack(const reliable_msg& msg);
+
+  /// Retransmits expired frames, called every tick.
+  void tick();
+
+  /// Sends a standalone ack unless data frames carried it already.
+  void ack_timeout();
+
+  /// Releases queued frames after the host wrote `n` bytes.
+  void written(size_t n);
+
+  /// Allows delivering `n` more messages to the application.
+  void grant(uint32_t n);
+
+  /// Sets the FEC group size and stops adapting it, 0 disables FEC.
+  void fec_group_size(uint32_t n);
+
+  reliability_state& state() {
+    return state_;
+  }
+
+  const reliability_state& state() const {
+    return state_;
+  }
+
+private:
+  void handle_frame(reliable_msg& msg);
+  void deliver_ready();
+  void make_ready(reliable_msg msg);
+  void receive_in_stream(reliable_msg msg);
+  void abandon_if_expired(send_window::entry& x);
+  void put_on_wire(send_window::entry& x);
+  void transmit(reliable_msg msg);
+  void send_frame(reliable_msg msg);
+  void drain_backlog();
+  void fast_retransmit(const reliable_msg& ack);
+  void send_acks();
+  void schedule_acks();
+  void flush_output();
+
+  reliability_state state_;
+  protocol_hooks hooks_;
+  caf::actor_id id_ = 0;
+};
+
+} // namespace relm
@@ -1,36 +1,100 @@
 #pragma once
 
-#include <array>
+#include <vector>
+#include <cstdint>
 
 #include <caf/all.hpp>
 #include <caf/io/all.hpp>
 
+#include "include/seq_num.hpp"
+#include "include/buffer_pool.hpp"
+
 namespace relm {
 
-using ack_atom        = caf::atom_constant<caf::atom("ack")>;
-using retransmit_atom = caf::atom_constant<caf::atom("retransmit")>;
+using ack_atom = caf::atom_constant<caf::atom("ack")>;
+
+/// Kinds of frames exchanged between two reliability actors.
+enum class frame_type : uint8_t {
+  data   = 0,
+  ack    = 1,
+  /// Forward error correction for a group of data frames, see fec.hpp.
+  parity = 2
+};
+
+/// An inclusive range of received sequence numbers above the cumulative ack.
+struct sack_range {
+  seq_num first;
+  seq_num last;
+};
+
+template <class Inspector>
+typename Inspector::result_type inspect(Inspector& f, sack_range& x) {
+  return f(caf::meta::type_name("sack_range"), x.first, x.last);
+}
+
+/// Bits of the `flags` field in a frame header.
+enum frame_flags : uint16_t {
+  /// The frame carries a cumulative ack and a list of SACK ranges.
+  has_acks       = 0x0001,
+  /// The frame carries an application atom and payload bytes.
+  has_payload    = 0x0002,
+  /// The payload is a single `int32_t` rather than opaque bytes.
+  scalar_payload = 0x0004,
+  /// The receiver delivers the frame on arrival instead of in stream order.
+  unordered      = 0x0008,
+  /// The sender gave up on the frame and dropped its payload, the receiver
+  /// skips it.
+  abandoned      = 0x0010,
+  /// The payload is a part of a larger message, see `fragment_index`.
+  fragment       = 0x0020
+};
 
 struct reliable_msg {
   template <class Inspector>
   friend typename Inspector::result_type inspect(Inspector& f, reliable_msg& x);
   friend std::string to_string(const reliable_msg& msg);
 
-  static reliable_msg ack(int32_t seq);
-  static reliable_msg ack(int32_t seq, int32_t num_nacks,
-                          std::array<int32_t, 3> nacks);
-  static reliable_msg msg(caf::atom_value atm, int32_t content, int32_t seq);
+  static reliable_msg ack(seq_num seq);
+  static reliable_msg ack(seq_num seq, std::vector<sack_range> sacks);
+  static reliable_msg msg(caf::atom_value atm, int32_t content,
+                          seq_num seq = 0);
+  static reliable_msg msg(caf::atom_value atm, shared_payload payload,
+                          seq_num seq = 0);
 
   reliable_msg();
-  reliable_msg(caf::atom_value atm, int32_t content, int32_t seq,
-               int32_t num_acks, std::array<int32_t, 3> nacks);
 
   bool operator<(const reliable_msg& other);
 
+  bool has(frame_flags flag) const {
+    return (flags & flag) != 0;
+  }
+
+  /// Returns the payload of a frame with the `scalar_payload` flag.
+  int32_t content() const;
+
+  frame_type type;
+  uint16_t flags;
+  seq_num seq;
+  // ack section, only valid with `has_acks`
+  seq_num ack_seq;
+  /// Number of frames after `ack_seq` the receiver accepts.
+  uint32_t window;
+  std::vector<sack_range> sacks;
+  // application data, only valid with `has_payload`
+  /// Independent ordering domain within the session.
+  uint16_t stream;
+  /// Position of the frame within its stream.
+  seq_num stream_seq;
   caf::atom_value atm;
-  int32_t content;
-  int32_t seq;
-  int32_t num_nacks;
-  std::array<int32_t, 3> nacks;
+  shared_payload payload;
+  // fragment section, only valid with `fragment`
+  /// Position among the fragments of the message, the first fragment has
+  /// the sequence number `seq - fragment_index`.
+  uint32_t fragment_index;
+  /// Position of the payload within the message.
+  uint32_t fragment_offset;
+  /// Size of the whole message.
+  uint32_t message_size;
 };
 
 bool operator<(const reliable_msg& a, const reliable_msg& b);
@@ -39,7 +103,9 @@ std::string to_string(const reliable_msg& msg);
 
 template <class Inspector>
 typename Inspector::result_type inspect(Inspector& f, reliable_msg& x) {
-  return f(caf::meta::type_name("reliable_msg"), x.atm, x.seq, x.content);
+  return f(caf::meta::type_name("reliable_msg"), x.type, x.flags, x.seq,
+           x.ack_seq, x.window, x.sacks, x.stream, x.stream_seq, x.atm,
+           x.payload, x.fragment_index, x.fragment_offset, x.message_size);
 }
 
 } // namespace relm
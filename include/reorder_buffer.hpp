@@ -0,0 +1,117 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+#include "include/reliable_msg.hpp"
+
+namespace relm {
+
+/// Fixed-capacity ring buffer for received frames. Accepts frames in the
+/// receive window `[next, next + capacity)`, which may wrap around. Frame
+/// `seq` occupies the slot `seq % ring_size(capacity)` and a presence bitmap
+/// tracks which slots hold a frame.
+class reorder_buffer {
+public:
+  enum insert_result {
+    /// Stored the frame.
+    accepted,
+    /// The frame is already stored.
+    duplicate,
+    /// The frame precedes the window and was delivered before.
+    old,
+    /// The frame is too far ahead, the window cannot hold it.
+    beyond_window
+  };
+
+  /// Creates a buffer that expects `first` as the first frame.
+  explicit reorder_buffer(size_t capacity = 1024, seq_num first = 0);
+
+  size_t capacity() const {
+    return capacity_;
+  }
+
+  /// Returns the number of stored frames.
+  size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  /// Returns the next sequence number for in-order delivery.
+  seq_num next() const {
+    return next_;
+  }
+
+  /// Returns the highest stored sequence number or `next() - 1` if empty.
+  seq_num highest() const {
+    return highest_;
+  }
+
+  /// Returns whether the frame `seq` is stored.
+  bool contains(seq_num seq) const {
+    return static_cast<seq_num>(seq - next_) < capacity()
+           && test(index(seq));
+  }
+
+  insert_result insert(reliable_msg msg) {
+    auto seq = msg.seq;
+    return insert(seq, std::move(msg));
+  }
+
+  /// Stores `msg` at position `seq` instead of its sequence number, e.g.,
+  /// its position within a stream.
+  insert_result insert(seq_num seq, reliable_msg msg);
+
+  /// Returns the first `max_ranges` ranges of stored frames in ascending
+  /// order. All of them lie above `next()`, since `next()` itself is never
+  /// stored.
+  std::vector<sack_range> ranges(size_t max_ranges = SIZE_MAX) const;
+
+  /// Removes all stored frames that directly follow each other starting at
+  /// `next()` and calls `f` for each of them, `f` may move from the frame.
+  /// Returns the number of frames.
+  template <class F>
+  size_t drain(F f) {
+    size_t res = 0;
+    for (auto i = index(next_); test(i); i = index(next_)) {
+      clear(i);
+      --size_;
+      ++next_;
+      ++res;
+      f(slots_[i]);
+      slots_[i] = reliable_msg{};
+    }
+    return res;
+  }
+
+private:
+  size_t index(seq_num seq) const {
+    return seq & (slots_.size() - 1);
+  }
+
+  bool test(size_t i) const {
+    return (bits_[i / 64] & (uint64_t{1} << (i % 64))) != 0;
+  }
+
+  void set(size_t i) {
+    bits_[i / 64] |= uint64_t{1} << (i % 64);
+  }
+
+  void clear(size_t i) {
+    bits_[i / 64] &= ~(uint64_t{1} << (i % 64));
+  }
+
+  size_t capacity_;
+  std::vector<reliable_msg> slots_;
+  std::vector<uint64_t> bits_;
+  seq_num next_;
+  seq_num highest_;
+  size_t size_;
+};
+
+} // namespace relm
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <utility>
+#include <algorithm>
+
+namespace relm {
+
+/// A FIFO queue in a ring of slots that grows but never shrinks, so pushing
+/// and popping do not allocate once the queue reached its peak size. Popped
+/// slots keep a moved-from element until they are reused.
+template <class T>
+class ring_queue {
+public:
+  ring_queue() : head_{0}, size_{0} {
+    // nop
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  T& front() {
+    return slots_[head_];
+  }
+
+  const T& front() const {
+    return slots_[head_];
+  }
+
+  void push_back(T x) {
+    if (size_ == slots_.size())
+      grow();
+    slots_[(head_ + size_) & (slots_.size() - 1)] = std::move(x);
+    ++size_;
+  }
+
+  void pop_front() {
+    // release resources of the element right away, e.g., payload buffers
+    slots_[head_] = T{};
+    head_ = (head_ + 1) & (slots_.size() - 1);
+    --size_;
+  }
+
+private:
+  // unrolls the ring into one twice as large
+  void grow() {
+    std::vector<T> slots(std::max(slots_.size() * 2, size_t{8}));
+    for (size_t i = 0; i < size_; ++i)
+      slots[i] = std::move(slots_[(head_ + i) & (slots_.size() - 1)]);
+    slots_ = std::move(slots);
+    head_ = 0;
+  }
+
+  std::vector<T> slots_;  // power of two
+  size_t head_;
+  size_t size_;
+};
+
+} // namespace relm
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+namespace relm {
+
+/// Estimates the retransmission timeout from round-trip time samples as
+/// described in RFC 6298, with exponential backoff on timeouts.
+class rto_estimator {
+public:
+  using duration = std::chrono::microseconds;
+
+  /// Creates an estimator that starts at `initial` and keeps the timeout in
+  /// `[min, max]`. `granularity` is the resolution of the timer driving
+  /// retransmissions.
+  rto_estimator(duration initial, duration min, duration max,
+                duration granularity);
+
+  rto_estimator();
+
+  /// Updates the estimate with a new measurement. Callers must not sample
+  /// retransmitted frames (Karn's rule). Resets any backoff.
+  void sample(duration rtt);
+
+  /// Doubles the timeout after a retransmission timer fired.
+  void backoff();
+
+  duration rto() const {
+    return rto_;
+  }
+
+  duration srtt() const {
+    return srtt_;
+  }
+
+  duration rttvar() const {
+    return rttvar_;
+  }
+
+  bool has_sample() const {
+    return has_sample_;
+  }
+
+  /// Returns how often the timeout was doubled since the last sample.
+  uint32_t backoffs() const {
+    return backoffs_;
+  }
+
+private:
+  duration clamp(duration x) const;
+
+  duration min_;
+  duration max_;
+  duration granularity_;
+  duration srtt_;
+  duration rttvar_;
+  duration rto_;
+  bool has_sample_;
+  uint32_t backoffs_;
+};
+
+} // namespace relm
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <chrono>
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+#include <cstdint>
+
+#include "include/reliable_msg.hpp"
+
+namespace relm {
+
+/// Fixed-capacity ring buffer holding sent but unacknowledged frames. The
+/// window spans the sequence numbers `[base, next)` and may wrap around.
+/// Frames occupy the slot `seq % n` for the smallest power of two `n` not
+/// below the capacity, which keeps consecutive frames in distinct slots
+/// across the wrap. Selectively acknowledged frames leave
+/// holes in the window until the cumulative ack passes them.
+class send_window {
+public:
+  /// A frame in flight and its transmission state.
+  struct entry {
+    reliable_msg msg;
+    /// Time of the most recent transmission.
+    std::chrono::high_resolution_clock::time_point sent_at;
+    /// Number of times the frame was put on the wire.
+    uint32_t transmissions = 0;
+    /// Set when a SACK reported the frame missing and it was resent early.
+    bool fast_retransmitted = false;
+    /// Set while the frame went out beyond the peer's window to probe for a
+    /// window update, its timeout then says nothing about congestion.
+    bool probe = false;
+    /// Time after which a partially reliable frame is abandoned.
+    std::chrono::high_resolution_clock::time_point expires_at =
+      std::chrono::high_resolution_clock::time_point::max();
+    /// Transmissions after which a partially reliable frame is abandoned,
+    /// zero for no limit.
+    uint32_t max_transmissions = 0;
+  };
+
+  /// Creates a window that assigns `first` to the first pushed frame.
+  explicit send_window(size_t capacity = 1024, seq_num first = 0);
+
+  size_t capacity() const {
+    return capacity_;
+  }
+
+  /// Returns the number of sequence numbers in flight.
+  size_t size() const {
+    return static_cast<seq_num>(next_ - base_);
+  }
+
+  bool empty() const {
+    return base_ == next_;
+  }
+
+  /// Returns the number of frames neither acknowledged nor SACKed.
+  size_t outstanding() const {
+    return outstanding_;
+  }
+
+  bool full() const {
+    return size() >= capacity();
+  }
+
+  /// Returns the oldest unacknowledged sequence number.
+  seq_num base() const {
+    return base_;
+  }
+
+  /// Returns the sequence number assigned to the next pushed frame.
+  seq_num next() const {
+    return next_;
+  }
+
+  /// Stores `msg` under the sequence number `next()`. The window must not
+  /// be full.
+  entry& push(reliable_msg msg);
+
+  /// Returns the unacknowledged frame for `seq` or `nullptr`.
+  entry* find(seq_num seq);
+
+  /// Removes all frames up to and including `seq`, calling `f` with the
+  /// entry of each of them. Returns the number of removed frames.
+  template <class F>
+  size_t ack(seq_num seq, F f) {
+    size_t res = 0;
+    while (base_ != next_ && seq_le(base_, seq)) {
+      auto& x = slots_[index(base_)];
+      if (x.used) {
+        f(x.value);
+        release(x);
+        ++res;
+      }
+      ++base_;
+    }
+    return res;
+  }
+
+  /// Removes the frames in `[first, last]` without moving the window base,
+  /// calling `f` for each of them. Returns the number of removed frames.
+  template <class F>
+  size_t sack(seq_num first, seq_num last, F f) {
+    size_t res = 0;
+    first = seq_max(first, base_);
+    last = seq_min(last, next_ - 1);
+    for (auto seq = first; seq_le(seq, last); ++seq) {
+      auto& x = slots_[index(seq)];
+      if (x.used) {
+        f(x.value);
+        release(x);
+        ++res;
+      }
+    }
+    return res;
+  }
+
+private:
+  struct slot {
+    bool used = false;
+    entry value;
+  };
+
+  size_t index(seq_num seq) const {
+    return seq & (slots_.size() - 1);
+  }
+
+  void release(slot& x);
+
+  size_t capacity_;
+  std::vector<slot> slots_;
+  seq_num base_;
+  seq_num next_;
+  size_t outstanding_;
+};
+
+} // namespace relm
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace relm {
+
+/// Sequence number of a frame or of a message within its stream. Sequence
+/// numbers wrap around and compare by serial number arithmetic (RFC 1982):
+/// `a` precedes `b` if `b` follows `a` by less than half the number space.
+/// Arithmetic on them is modulo 2^32, hence a session never runs out of
+/// sequence numbers as long as less than 2^31 of them are in use at once.
+using seq_num = uint32_t;
+
+/// Half the sequence number space, the largest distance at which two
+/// sequence numbers are still ordered.
+constexpr seq_num seq_half = seq_num{1} << 31;
+
+/// Returns whether `a` precedes `b`.
+constexpr bool seq_lt(seq_num a, seq_num b) {
+  return a != b && static_cast<seq_num>(b - a) < seq_half;
+}
+
+constexpr bool seq_le(seq_num a, seq_num b) {
+  return !seq_lt(b, a);
+}
+
+constexpr bool seq_gt(seq_num a, seq_num b) {
+  return seq_lt(b, a);
+}
+
+constexpr bool seq_ge(seq_num a, seq_num b) {
+  return !seq_lt(a, b);
+}
+
+/// Returns the later of `a` and `b`.
+constexpr seq_num seq_max(seq_num a, seq_num b) {
+  return seq_lt(a, b) ? b : a;
+}
+
+/// Returns the earlier of `a` and `b`.
+constexpr seq_num seq_min(seq_num a, seq_num b) {
+  return seq_lt(a, b) ? a : b;
+}
+
+/// Returns the sequence number closest to `ref` whose low `bits` bits equal
+/// those of `x`, i.e., undoes truncating a sequence number to `bits` bits as
+/// long as it was less than 2^(bits - 1) away from `ref`. Requires
+/// `bits < 32`.
+inline seq_num seq_expand(seq_num x, seq_num ref, unsigned bits) {
+  auto space = seq_num{1} << bits;
+  // forward distance from `ref` within the truncated space
+  auto d = static_cast<seq_num>(x - ref) & (space - 1);
+  return d < space / 2 ? ref + d : ref + d - space;
+}
+
+/// Returns the smallest power of two not below `n`. Ring buffers indexed by
+/// `seq % ring_size(n)` keep `n` consecutive sequence numbers in distinct
+/// slots even when they wrap around, since the size divides 2^32.
+inline size_t ring_size(size_t n) {
+  size_t res = 1;
+  while (res < n)
+    res <<= 1;
+  return res;
+}
+
+} // namespace relm
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "include/seq_num.hpp"
+
+namespace relm {
+
+/// A hashed timing wheel keyed by sequence number. Time advances in discrete
+/// ticks driven by the owner. Arming and cancelling a timer is O(1), a tick
+/// only visits the timers hashed into the current slot. Timers live in a
+/// fixed array indexed by their key, linked into the list of their slot, so
+/// the wheel never allocates after construction. It holds timers for up to
+/// `capacity` consecutive keys, arming a key replaces the timer of any key
+/// sharing its position.
+class timer_wheel {
+public:
+  using key_type = seq_num;
+
+  explicit timer_wheel(size_t capacity = 1024, size_t num_slots = 256);
+
+  /// Arms the timer for `key` to expire `ticks` ticks from now, replacing any
+  /// timer previously armed for `key`.
+  void arm(key_type key, size_t ticks);
+
+  /// Disarms the timer for `key` if present.
+  void cancel(key_type key);
+
+  bool armed(key_type key) const {
+    auto& x = timers_[index(key)];
+    return x.armed && x.key == key;
+  }
+
+  /// Returns the number of armed timers.
+  size_t size() const {
+    return size_;
+  }
+
+  /// Advances the wheel by one tick and calls `f` with the key of each timer
+  /// that expired. `f` may arm new timers.
+  template <class F>
+  void tick(F f) {
+    ++now_;
+    expired_.clear();
+    auto i = slots_[now_ % slots_.size()];
+    while (i != nil) {
+      auto& x = timers_[i];
+      auto next = x.next;
+      // others are due in a later rotation of the wheel
+      if (x.deadline == now_) {
+        unlink(i);
+        expired_.push_back(x.key);
+      }
+      i = next;
+    }
+    for (auto key : expired_)
+      f(key);
+  }
+
+private:
+  static constexpr uint32_t nil = UINT32_MAX;
+
+  struct timer {
+    key_type key = 0;
+    uint64_t deadline = 0;
+    uint32_t prev = nil;
+    uint32_t next = nil;
+    bool armed = false;
+  };
+
+  uint32_t index(key_type key) const {
+    return static_cast<uint32_t>(key & (timers_.size() - 1));
+  }
+
+  void link(uint32_t i);
+
+  void unlink(uint32_t i);
+
+  uint64_t now_;
+  size_t size_;
+  std::vector<timer> timers_;    // power of two
+  std::vector<uint32_t> slots_;  // first timer of each slot
+  std::vector<key_type> expired_;
+};
+
+} // namespace relm
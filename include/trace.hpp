@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <cstdint>
+#include <iosfwd>
+
+// Trace levels, calls above RELM_TRACE_LEVEL compile to nothing.
+#define RELM_LEVEL_OFF     0
+#define RELM_LEVEL_ERROR   1
+#define RELM_LEVEL_WARNING 2
+#define RELM_LEVEL_INFO    3
+#define RELM_LEVEL_DEBUG   4
+#define RELM_LEVEL_TRACE   5
+
+#ifndef RELM_TRACE_LEVEL
+# define RELM_TRACE_LEVEL RELM_LEVEL_INFO
+#endif
+
+/// Records a trace event if `level` (one of ERROR, WARNING, INFO, DEBUG or
+/// TRACE) is enabled at compile time and at runtime, e.g.,
+/// `RELM_TRACE(DEBUG, trace::sent, self->id(), seq, size)`.
+#define RELM_TRACE(level, ...)                                                 \
+  do {                                                                         \
+    if (RELM_LEVEL_##level <= RELM_TRACE_LEVEL                                 \
+        && ::relm::trace::enabled(RELM_LEVEL_##level))                         \
+      ::relm::trace::record(RELM_LEVEL_##level, __VA_ARGS__);                  \
+  } while (false)
+
+namespace relm {
+namespace trace {
+
+/// Events of the reliability protocol. Records store the event id and its
+/// arguments in binary form, text is only produced when draining them.
+enum event : uint8_t {
+  sent,               // seq, a: payload bytes
+  retransmitted,      // seq, a: transmissions, b: RTO in ms
+  fast_retransmitted, // seq
+  ack_sent,           // seq: cumulative ack, a: SACK ranges
+  ack_received,       // seq: cumulative ack, a: SACK ranges
+  received,           // seq
+  received_old,       // seq, a: next expected
+  received_duplicate, // seq
+  received_early,     // seq, a: next expected in its stream
+  beyond_window,      // seq, a: next expected
+  paused,             // a: backlog size
+  resumed,            //
+  lost,               // seq, dropped by the broker
+  delayed,            // seq, a: delay in ms
+  cwnd_reduced,       // seq: lost frame, a: cwnd, b: ssthresh
+  abandoned,          // seq, a: transmissions
+  skipped,            // seq, abandoned by the sender
+  recovered           // seq, restored from a parity frame
+};
+
+/// A single binary trace record.
+struct trace_record {
+  int64_t time;   // nanoseconds since the clock's epoch
+  uint64_t actor; // id of the recording actor
+  int64_t a;
+  int64_t b;
+  uint32_t seq;
+  uint8_t level;
+  uint8_t event;
+};
+
+extern std::atomic<int> runtime_level;
+
+inline bool enabled(int level) {
+  return level <= runtime_level.load(std::memory_order_relaxed);
+}
+
+/// Sets the runtime level, records above it are discarded.
+void set_level(int level);
+
+/// Parses a level name such as "debug", returns -1 for unknown names.
+int parse_level(const std::string& name);
+
+/// Pushes a record into the lock-free trace buffer. Drops the record if the
+/// buffer is full.
+void record(int level, event ev, uint64_t actor, uint32_t seq = 0,
+            int64_t a = 0, int64_t b = 0);
+
+/// Starts a background thread that formats buffered records to `out`
+/// every `interval`. Remaining records are flushed at program exit.
+void start(std::ostream& out,
+           std::chrono::milliseconds interval = std::chrono::milliseconds(50));
+
+/// Formats all buffered records to `out`, returns the number of records.
+size_t drain(std::ostream& out);
+
+/// Returns the number of records dropped because the buffer was full.
+uint64_t dropped();
+
+} // namespace trace
+} // namespace relm
@@ -1,49 +1,89 @@
 #pragma once
 // simple_broker example from CAF as a base
 
-#ifdef WIN32
-# define _WIN32_WINNT 0x0600
-# include <Winsock2.h>
-#else
-# include <arpa/inet.h> // htonl
-#endif
-
 #include <chrono>
+#include <string>
+#include <functional>
 #include <vector>
 #include <iostream>
 
 #include <caf/all.hpp>
 #include <caf/io/all.hpp>
 
+#include "include/impairment.hpp"
+#include "include/reliability_actor.hpp"
+
 namespace relm {
 
-// utility function for sending an integer type
-template <class T>
-int write_int(caf::io::broker* self,
-              caf::io::connection_handle hdl, T value) {
-  using unsigned_type = typename std::make_unsigned<T>::type;
-  auto cpy = static_cast<T>(htonl(static_cast<unsigned_type>(value)));
-  self->write(hdl, sizeof(T), &cpy);
-  self->flush(hdl);
-  return sizeof(T);
-}
-int write_int(caf::io::broker* self,
-              caf::io::connection_handle hdl, uint64_t value);
-
-// utility function for reading an integer from incoming data
-template <class T>
-int read_int(const void* data, T& storage) {
-  using unsigned_type = typename std::make_unsigned<T>::type;
-  memcpy(&storage, data, sizeof(T));
-  storage = static_cast<T>(ntohl(static_cast<unsigned_type>(storage)));
-  return sizeof(T);
-}
-int read_int(const void* data, uint64_t& storage);
+using flush_atom = caf::atom_constant<caf::atom("flush")>;
+
+/// Configures how the broker coalesces outgoing frames and how it impairs
+/// incoming frames.
+struct broker_config {
+  /// Maximum number of frames in the write buffer before flushing it.
+  size_t batch_size = 16;
+  /// Maximum time a frame waits in the write buffer before flushing it.
+  std::chrono::microseconds linger{1000};
+  /// Simulated network applied to incoming frames. Each connection gets its
+  /// own stage, seeded with `impairment.seed` plus the connection number.
+  impairment_config impairment;
+  /// Runs the reliability protocol inside the broker of each connection
+  /// instead of a separate reliability actor, only delivery to the
+  /// application crosses an actor boundary.
+  bool fused = false;
+};
+
+/// Command line representation of an `impairment_config`, shared by all
+/// executables.
+struct impairment_options {
+  uint64_t seed = 0;
+  std::string loss_model = "bernoulli";
+  double loss_rate = impairment_config{}.loss_rate;
+  double ge_p = impairment_config{}.ge_p;
+  double ge_r = impairment_config{}.ge_r;
+  double ge_loss_good = impairment_config{}.ge_loss_good;
+  double ge_loss_bad = impairment_config{}.ge_loss_bad;
+  uint32_t delay_ms = impairment_config{}.delay.count();
+  std::string delay_model = "geometric";
+  double reorder_rate = impairment_config{}.reorder_rate;
+  uint32_t reorder_delay_ms = impairment_config{}.reorder_delay.count();
+  double duplicate_rate = impairment_config{}.duplicate_rate;
+  uint64_t bandwidth = impairment_config{}.bandwidth;
+
+  /// Registers all options at `grp`.
+  void add(caf::actor_system_config::opt_group& grp);
+
+  /// Converts the options, replacing seed 0 with a random seed. Returns an
+  /// error description or an empty string on success.
+  std::string convert(impairment_config& x) const;
+};
 
 caf::behavior broker_impl(caf::io::broker* self,
                           caf::io::connection_handle hdl,
-                          const caf::actor& buddy);
+                          const caf::actor& buddy,
+                          const broker_config& cfg);
+
+/// Runs the reliability protocol for `app` directly in the handlers of the
+/// broker: incoming frames reach the protocol without a mailbox in between
+/// and outgoing frames go straight into the write buffer. The application
+/// sends its messages to the broker, which also answers the queries of a
+/// reliability actor.
+caf::behavior fused_broker(caf::io::broker* self,
+                           caf::io::connection_handle hdl,
+                           const caf::actor& app,
+                           const reliability_config& rcfg,
+                           const broker_config& cfg);
+
+/// Creates the application actor for a new session.
+using app_factory = std::function<caf::actor (caf::actor_system&)>;
+
+/// Accepts connections until killed. Each connection gets an independent
+/// session: a reliability actor, an application created by `make_app` and a
+/// broker for the connection, or a fused broker and the application if
+/// `cfg.fused` is set. The application is shut down with its session.
 caf::behavior server(caf::io::broker* self,
-                     const caf::actor& buddy);
+                     const app_factory& make_app,
+                     const reliability_config& rcfg,
+                     const broker_config& cfg);
 
 } // namespace relm
@@ -0,0 +1,83 @@
+
+#include <mutex>
+
+#include "include/buffer_pool.hpp"
+
+namespace relm {
+
+namespace {
+
+// released buffers kept for reuse, further ones are freed
+constexpr size_t max_pooled_buffers = 8192;
+
+// larger buffers are freed instead of holding on to their memory
+constexpr size_t max_pooled_capacity = 64 * 1024;
+
+// Buffers are acquired and released by different actors on different
+// threads, e.g., the sender fills a buffer that the receiving side releases,
+// so all threads share a single pool.
+struct buffer_pool {
+  std::mutex mtx;
+  std::vector<pooled_buffer*> free;
+  std::atomic<uint64_t> allocations{0};
+
+  buffer_pool() {
+    free.reserve(max_pooled_buffers);
+  }
+
+  ~buffer_pool() {
+    for (auto x : free)
+      delete x;
+  }
+};
+
+buffer_pool& pool() {
+  static buffer_pool instance;
+  return instance;
+}
+
+} // namespace anonymous
+
+void intrusive_ptr_release(pooled_buffer* x) {
+  if (x->rc_.fetch_sub(1, std::memory_order_acq_rel) != 1)
+    return;
+  if (x->bytes.capacity() <= max_pooled_capacity) {
+    x->bytes.clear();
+    auto& p = pool();
+    std::unique_lock<std::mutex> guard{p.mtx};
+    if (p.free.size() < max_pooled_buffers) {
+      p.free.push_back(x);
+      return;
+    }
+  }
+  delete x;
+}
+
+buffer_ptr make_buffer() {
+  auto& p = pool();
+  {
+    std::unique_lock<std::mutex> guard{p.mtx};
+    if (!p.free.empty()) {
+      auto x = p.free.back();
+      p.free.pop_back();
+      return buffer_ptr{x};
+    }
+  }
+  p.allocations.fetch_add(1, std::memory_order_relaxed);
+  return buffer_ptr{new pooled_buffer};
+}
+
+uint64_t pool_allocations() {
+  return pool().allocations.load(std::memory_order_relaxed);
+}
+
+shared_payload::shared_payload(const char* first, const char* last) {
+  if (first == last)
+    return;
+  auto buf = make_buffer();
+  buf->bytes.assign(first, last);
+  size_ = buf->bytes.size();
+  buf_ = std::move(buf);
+}
+
+} // namespace relm
@@ -0,0 +1,208 @@
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include "include/congestion.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace relm {
+
+namespace {
+
+// initial window in frames (RFC 6928)
+constexpr double initial_window = 10;
+
+// smallest window after a loss
+constexpr double min_window = 2;
+
+class no_congestion_control : public congestion_controller {
+public:
+  explicit no_congestion_control(double max_cwnd)
+      : congestion_controller(max_cwnd, max_cwnd) {
+    // nop
+  }
+
+  void on_ack(size_t, clock::time_point, duration) override {
+    // nop
+  }
+
+  void on_loss(clock::time_point) override {
+    // nop
+  }
+
+  void on_timeout(clock::time_point) override {
+    // nop
+  }
+
+  const char* name() const override {
+    return "none";
+  }
+};
+
+class aimd : public congestion_controller {
+public:
+  explicit aimd(double max_cwnd)
+      : congestion_controller(initial_window, max_cwnd) {
+    // nop
+  }
+
+  void on_ack(size_t acked, clock::time_point, duration) override {
+    acked = slow_start(acked);
+    // one frame per window of acked frames
+    cwnd_ += static_cast<double>(acked) / cwnd_;
+    clamp();
+  }
+
+  void on_loss(clock::time_point) override {
+    ssthresh_ = max(cwnd_ / 2, min_window);
+    cwnd_ = ssthresh_;
+  }
+
+  void on_timeout(clock::time_point) override {
+    ssthresh_ = max(cwnd_ / 2, min_window);
+    cwnd_ = 1;
+  }
+
+  const char* name() const override {
+    return "aimd";
+  }
+};
+
+class cubic : public congestion_controller {
+public:
+  explicit cubic(double max_cwnd)
+      : congestion_controller(initial_window, max_cwnd),
+        w_max_(0),
+        k_(0),
+        origin_(0),
+        epoch_started_(false) {
+    // nop
+  }
+
+  void on_ack(size_t acked, clock::time_point now, duration srtt) override {
+    acked = slow_start(acked);
+    if (acked == 0)
+      return;
+    if (!epoch_started_) {
+      epoch_started_ = true;
+      epoch_start_ = now;
+      if (cwnd_ < w_max_) {
+        k_ = cbrt((w_max_ - cwnd_) / c);
+        origin_ = w_max_;
+      } else {
+        k_ = 0;
+        origin_ = cwnd_;
+      }
+    }
+    auto rtt = max(duration_cast<std::chrono::duration<double>>(srtt).count(),
+                   0.001);
+    auto t = duration_cast<std::chrono::duration<double>>(
+               now - epoch_start_).count() + rtt;
+    auto target = origin_ + c * pow(t - k_, 3);
+    // never grow slower than Reno would in the same time
+    auto w_est = w_max_ * beta + 3 * (1 - beta) / (1 + beta) * t / rtt;
+    auto n = static_cast<double>(acked);
+    if (target > cwnd_)
+      cwnd_ += (target - cwnd_) / cwnd_ * n;
+    else
+      cwnd_ += 0.01 * n / cwnd_;
+    cwnd_ = max(cwnd_, w_est);
+    clamp();
+  }
+
+  void on_loss(clock::time_point) override {
+    reduce();
+    cwnd_ = ssthresh_;
+  }
+
+  void on_timeout(clock::time_point) override {
+    reduce();
+    cwnd_ = 1;
+  }
+
+  const char* name() const override {
+    return "cubic";
+  }
+
+private:
+  static constexpr double c = 0.4;
+  static constexpr double beta = 0.7;
+
+  void reduce() {
+    epoch_started_ = false;
+    // fast convergence: release bandwidth if the window shrank since the
+    // last loss
+    if (cwnd_ < w_max_)
+      w_max_ = cwnd_ * (1 + beta) / 2;
+    else
+      w_max_ = cwnd_;
+    ssthresh_ = max(cwnd_ * beta, min_window);
+  }
+
+  double w_max_;
+  double k_;
+  double origin_;
+  bool epoch_started_;
+  clock::time_point epoch_start_;
+};
+
+constexpr double cubic::c;
+constexpr double cubic::beta;
+
+} // namespace anonymous
+
+bool parse_congestion_algorithm(const string& name, congestion_algorithm& x) {
+  if (name == "none")
+    x = congestion_algorithm::none;
+  else if (name == "aimd")
+    x = congestion_algorithm::aimd;
+  else if (name == "cubic")
+    x = congestion_algorithm::cubic;
+  else
+    return false;
+  return true;
+}
+
+congestion_controller::congestion_controller(double initial_cwnd,
+                                             double max_cwnd)
+    : cwnd_(min(initial_cwnd, max_cwnd)),
+      ssthresh_(numeric_limits<double>::infinity()),
+      max_cwnd_(max_cwnd) {
+  // nop
+}
+
+congestion_controller::~congestion_controller() {
+  // nop
+}
+
+size_t congestion_controller::slow_start(size_t acked) {
+  while (acked > 0 && cwnd_ < ssthresh_) {
+    cwnd_ += 1;
+    --acked;
+  }
+  clamp();
+  return acked;
+}
+
+void congestion_controller::clamp() {
+  cwnd_ = min(cwnd_, max_cwnd_);
+}
+
+unique_ptr<congestion_controller>
+make_congestion_controller(congestion_algorithm algorithm, size_t max_cwnd) {
+  auto x = static_cast<double>(max_cwnd);
+  switch (algorithm) {
+    case congestion_algorithm::none:
+      return unique_ptr<congestion_controller>{new no_congestion_control(x)};
+    case congestion_algorithm::aimd:
+      return unique_ptr<congestion_controller>{new aimd(x)};
+    case congestion_algorithm::cubic:
+      return unique_ptr<congestion_controller>{new cubic(x)};
+  }
+  return nullptr;
+}
+
+} // namespace relm
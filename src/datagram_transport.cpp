@@ -0,0 +1,300 @@
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cerrno>
+#include <cstring>
+
+#include <poll.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "include/trace.hpp"
+#include "include/framing.hpp"
+#include "include/datagram_transport.hpp"
+
+using std::endl;
+using namespace std::chrono;
+using namespace caf;
+
+namespace relm {
+
+namespace {
+
+// bounds the time it takes the reader thread to notice a shutdown
+constexpr int poll_timeout_ms = 100;
+
+// kernel buffers of each socket, datagrams arriving at a full receive buffer
+// are dropped like any other loss
+constexpr int socket_buffer_size = 4 * 1024 * 1024;
+
+// each frame takes up to two elements of a scatter-gather write, which
+// stays below the IOV_MAX of 1024 on Linux
+constexpr size_t max_frames_per_datagram = 512;
+
+// Owns a UDP socket and the thread reading from it. CAF brokers only manage
+// stream connections, so the endpoint actor writes to the socket and a
+// dedicated thread blocks on reading from it.
+struct datagram_socket {
+  int fd;
+  // false until the server received the first datagram of its peer
+  bool connected;
+  std::atomic<bool> done;
+  std::thread reader;
+
+  datagram_socket(int x, bool is_connected)
+      : fd(x),
+        connected(is_connected),
+        done(false) {
+    // nop
+  }
+
+  ~datagram_socket() {
+    done = true;
+    if (reader.joinable())
+      reader.join();
+    ::close(fd);
+  }
+};
+
+using socket_ptr = std::shared_ptr<datagram_socket>;
+
+// Frames of the next datagram. Headers are encoded into one buffer, the
+// payloads stay in the buffers of their messages and go out with a single
+// scatter-gather write.
+struct datagram_state {
+  byte_buffer headers;
+  // end of each frame's header in `headers`
+  std::vector<size_t> header_ends;
+  std::vector<shared_payload> payloads;
+  std::vector<iovec> iov;
+  size_t size = 0;
+  bool linger_timer_set = false;
+
+  size_t pending() const {
+    return payloads.size();
+  }
+
+  void clear() {
+    headers.clear();
+    header_ends.clear();
+    payloads.clear();
+    size = 0;
+  }
+};
+
+int open_socket() {
+  auto fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0)
+    return fd;
+  auto size = socket_buffer_size;
+  ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+  ::setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+  return fd;
+}
+
+// Runs in the reader thread of `sock` until the socket is destroyed. Passes
+// all frames of a datagram through the impairment stage to `buddy`.
+void read_loop(datagram_socket* sock, actor buddy, impairment link,
+               actor_id id) {
+  byte_buffer buf(max_datagram_size);
+  auto forward = [&](const frame_view& frame) {
+    auto fate = link.apply(impairment::clock::now(), frame.size());
+    if (fate.copies == 0) {
+      RELM_TRACE(TRACE, trace::lost, id, frame.seq);
+      return;
+    }
+    auto msg = frame.to_msg();
+    for (size_t i = 0; i < fate.copies; ++i) {
+      auto delay = fate.delays[i];
+      if (delay.count() == 0) {
+        anon_send(buddy, recv_atom::value, msg);
+        continue;
+      }
+      RELM_TRACE(TRACE, trace::delayed, id, frame.seq,
+                 duration_cast<milliseconds>(delay).count());
+      delayed_anon_send(buddy, delay, recv_atom::value, msg);
+    }
+  };
+  pollfd pfd;
+  pfd.fd = sock->fd;
+  pfd.events = POLLIN;
+  while (!sock->done) {
+    pfd.revents = 0;
+    if (::poll(&pfd, 1, poll_timeout_ms) <= 0)
+      continue;
+    sockaddr_storage from;
+    socklen_t from_len = sizeof(from);
+    auto n = ::recvfrom(sock->fd, buf.data(), buf.size(), 0,
+                        reinterpret_cast<sockaddr*>(&from), &from_len);
+    // errors such as ECONNREFUSED only tell us that the peer is not up yet,
+    // the reliability layer retransmits
+    if (n <= 0)
+      continue;
+    if (!sock->connected) {
+      // the server talks to the first peer only, the kernel filters out
+      // datagrams from other sources after connecting
+      if (::connect(sock->fd, reinterpret_cast<sockaddr*>(&from), from_len)
+          != 0)
+        continue;
+      sock->connected = true;
+    }
+    // a datagram holds whole frames, drop whatever follows a broken frame
+    size_t consumed = 0;
+    decode_all(buf.data(), static_cast<size_t>(n), consumed, forward);
+  }
+}
+
+behavior datagram_endpoint(event_based_actor* self, socket_ptr sock,
+                           const actor& buddy, const broker_config& cfg) {
+  self->monitor(buddy);
+  self->set_down_handler([=](down_msg& dm) {
+    if (dm.source == buddy) {
+      aout(self) << "[D] Buddy is down." << endl;
+      self->quit(dm.reason);
+    }
+  });
+  self->send(buddy, register_atom::value, self);
+  sock->reader = std::thread{read_loop, sock.get(), buddy,
+                             impairment{cfg.impairment}, self->id()};
+  auto state = std::make_shared<datagram_state>();
+  state->headers.reserve(max_datagram_size);
+  // a failed write loses the frames in it, e.g., the server writes before
+  // it knows its peer
+  auto flush = [=] {
+    auto& st = *state;
+    if (st.pending() == 0)
+      return;
+    auto& iov = st.iov;
+    iov.clear();
+    size_t first = 0;
+    for (size_t i = 0; i < st.pending(); ++i) {
+      iov.push_back(iovec{st.headers.data() + first,
+                          st.header_ends[i] - first});
+      if (!st.payloads[i].empty())
+        iov.push_back(iovec{const_cast<char*>(st.payloads[i].data()),
+                            st.payloads[i].size()});
+      first = st.header_ends[i];
+    }
+    msghdr hdr;
+    std::memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_iov = iov.data();
+    hdr.msg_iovlen = iov.size();
+    ::sendmsg(sock->fd, &hdr, 0);
+    // lets the reliability actor release frames it held back
+    self->send(buddy, written_atom::value, static_cast<uint64_t>(st.size));
+    st.clear();
+  };
+  return {
+    [=](send_atom, const reliable_msg& msg) {
+      // collect frames into the datagram and send it once per batch or
+      // before it grows too large
+      auto& st = *state;
+      auto size = encoded_size(msg);
+      if (size > max_datagram_size) {
+        // retransmissions would fail the same way, see fit_to_datagrams
+        aout(self) << "[D] Frame of " << size
+                   << " bytes exceeds the datagram size." << endl;
+        self->send_exit(buddy, exit_reason::remote_link_unreachable);
+        self->quit(exit_reason::remote_link_unreachable);
+        return;
+      }
+      if (st.size + size > max_datagram_size)
+        flush();
+      encode_header(st.headers, msg);
+      st.header_ends.push_back(st.headers.size());
+      st.payloads.push_back(msg.has(has_payload) ? msg.payload
+                                                 : shared_payload{});
+      st.size += size;
+      if (st.pending() >= cfg.batch_size
+          || st.pending() == max_frames_per_datagram
+          || cfg.linger.count() == 0) {
+        flush();
+      } else if (!st.linger_timer_set) {
+        st.linger_timer_set = true;
+        self->delayed_send(self, cfg.linger, flush_atom::value);
+      }
+    },
+    [=](flush_atom) {
+      state->linger_timer_set = false;
+      flush();
+    }
+  };
+}
+
+} // namespace anonymous
+
+void fit_to_datagrams(reliability_config& cfg) {
+  if (cfg.max_fragment_size == 0
+      || cfg.max_fragment_size > max_datagram_fragment_size)
+    cfg.max_fragment_size = max_datagram_fragment_size;
+}
+
+bool parse_transport(const std::string& name, transport& x) {
+  if (name == "tcp")
+    x = transport::tcp;
+  else if (name == "udp")
+    x = transport::udp;
+  else
+    return false;
+  return true;
+}
+
+expected<actor> spawn_datagram_server(actor_system& sys, uint16_t& port,
+                                      const actor& buddy,
+                                      const broker_config& cfg) {
+  auto fd = open_socket();
+  if (fd < 0)
+    return make_error(sec::cannot_open_port, std::strerror(errno));
+  sockaddr_in addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  socklen_t len = sizeof(addr);
+  if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), len) != 0
+      || ::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) != 0) {
+    auto err = make_error(sec::cannot_open_port, std::strerror(errno));
+    ::close(fd);
+    return err;
+  }
+  port = ntohs(addr.sin_port);
+  auto sock = std::make_shared<datagram_socket>(fd, false);
+  return sys.spawn(datagram_endpoint, std::move(sock), buddy, cfg);
+}
+
+expected<actor> spawn_datagram_client(actor_system& sys,
+                                      const std::string& host, uint16_t port,
+                                      const actor& buddy,
+                                      const broker_config& cfg) {
+  addrinfo hints;
+  std::memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  addrinfo* addrs = nullptr;
+  auto res = ::getaddrinfo(host.c_str(), std::to_string(port).c_str(),
+                           &hints, &addrs);
+  if (res != 0)
+    return make_error(sec::cannot_connect_to_node, ::gai_strerror(res));
+  auto fd = open_socket();
+  if (fd < 0) {
+    ::freeaddrinfo(addrs);
+    return make_error(sec::cannot_connect_to_node, std::strerror(errno));
+  }
+  // fixes the peer address, the kernel picks a local port
+  auto connected = ::connect(fd, addrs->ai_addr, addrs->ai_addrlen) == 0;
+  ::freeaddrinfo(addrs);
+  if (!connected) {
+    auto err = make_error(sec::cannot_connect_to_node, std::strerror(errno));
+    ::close(fd);
+    return err;
+  }
+  auto sock = std::make_shared<datagram_socket>(fd, true);
+  return sys.spawn(datagram_endpoint, std::move(sock), buddy, cfg);
+}
+
+} // namespace relm
@@ -0,0 +1,142 @@
+
+#include <cmath>
+#include <algorithm>
+
+#include "include/fec.hpp"
+
+using namespace std;
+
+namespace relm {
+
+namespace {
+
+constexpr size_t member_size = sizeof(seq_num) + sizeof(uint32_t);
+
+static_assert(sizeof(uint32_t) + max_fec_group_size * member_size
+              == max_parity_overhead, "parity layout changed");
+
+// Writes `msg` without its ack section to `buf`. Acks are outdated by the
+// time a frame is restored, only the data is worth protecting.
+void encode_protected(byte_buffer& buf, reliable_msg& msg) {
+  buf.clear();
+  auto flags = msg.flags;
+  msg.flags = static_cast<uint16_t>(flags & ~has_acks);
+  encode(buf, msg);
+  msg.flags = flags;
+}
+
+// XORs `src` into `dst`, growing `dst` with zeros if needed.
+void xor_into(byte_buffer& dst, const byte_buffer& src) {
+  if (dst.size() < src.size())
+    dst.resize(src.size(), 0);
+  for (size_t i = 0; i < src.size(); ++i)
+    dst[i] ^= src[i];
+}
+
+} // namespace anonymous
+
+size_t adapt_fec_group_size(double p) {
+  if (p <= 0)
+    return max_fec_group_size;
+  auto n = static_cast<size_t>(floor(1 / (2 * p)));
+  return min(max(n, size_t{2}), max_fec_group_size);
+}
+
+fec_encoder::fec_encoder(size_t group_size)
+    : group_size_(min(group_size, max_fec_group_size)),
+      protected_bytes_(0),
+      parity_bytes_(0) {
+  // nop
+}
+
+bool fec_encoder::add(reliable_msg& msg, reliable_msg& parity) {
+  if (group_size_ == 0) {
+    members_.clear();
+    parity_.clear();
+    return false;
+  }
+  encode_protected(scratch_, msg);
+  xor_into(parity_, scratch_);
+  members_.emplace_back(msg.seq, static_cast<uint32_t>(scratch_.size()));
+  protected_bytes_ += scratch_.size();
+  if (members_.size() < group_size_)
+    return false;
+  parity = reliable_msg{};
+  parity.type = frame_type::parity;
+  parity.flags = has_payload;
+  auto ptr = make_buffer();
+  auto& buf = ptr->bytes;
+  buf.reserve(sizeof(uint32_t) + members_.size() * member_size
+              + parity_.size());
+  write_int(buf, static_cast<uint32_t>(members_.size()));
+  for (auto& x : members_) {
+    write_int(buf, x.first);
+    write_int(buf, x.second);
+  }
+  buf.insert(buf.end(), parity_.begin(), parity_.end());
+  parity_bytes_ += buf.size();
+  parity.payload = shared_payload{move(ptr)};
+  members_.clear();
+  parity_.clear();
+  return true;
+}
+
+fec_decoder::fec_decoder(size_t history) : history_(history) {
+  // nop
+}
+
+void fec_decoder::add(reliable_msg& msg) {
+  auto& buf = frames_[msg.seq];
+  encode_protected(buf, msg);
+  order_.push_back(msg.seq);
+  if (order_.size() > history_) {
+    frames_.erase(order_.front());
+    order_.pop_front();
+  }
+}
+
+bool fec_decoder::recover(const reliable_msg& parity, reliable_msg& res) {
+  auto data = parity.payload.data();
+  auto size = parity.payload.size();
+  uint32_t count = 0;
+  if (size < sizeof(uint32_t))
+    return false;
+  size_t offset = read_int(data, count);
+  if ((size - offset) / member_size < count)
+    return false;
+  auto parity_offset = offset + count * member_size;
+  seq_num missing_seq = 0;
+  uint32_t missing_length = 0;
+  auto num_missing = 0;
+  scratch_.assign(data + parity_offset, data + size);
+  for (uint32_t i = 0; i < count; ++i) {
+    seq_num seq;
+    uint32_t length;
+    offset += read_int(data + offset, seq);
+    offset += read_int(data + offset, length);
+    auto j = frames_.find(seq);
+    if (j == frames_.end()) {
+      if (++num_missing > 1)
+        return false;
+      missing_seq = seq;
+      missing_length = length;
+    } else if (j->second.size() != length) {
+      // a different transmission of the frame, e.g., after abandoning it
+      return false;
+    } else {
+      xor_into(scratch_, j->second);
+    }
+  }
+  if (num_missing == 0 || missing_length > scratch_.size())
+    return false;
+  frame_view x;
+  if (decode(scratch_.data(), missing_length, x) != decode_status::complete
+      || x.size() != missing_length || x.type != frame_type::data)
+    return false;
+  // the parity frame lists the full sequence number
+  res = x.to_msg();
+  restore_seqs(res, missing_seq, 0);
+  return res.seq == missing_seq;
+}
+
+} // namespace relm
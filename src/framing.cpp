@@ -0,0 +1,308 @@
+
+#include "include/framing.hpp"
+
+using namespace std;
+using namespace caf;
+
+namespace relm {
+
+namespace {
+
+constexpr size_t seq_size = seq_bits / 8;
+
+// Atoms sent as a single byte, code 0 precedes a full atom instead.
+// Appending keeps the codes of all others, any other change needs a new
+// frame version.
+const atom_value short_atoms[] = {
+  static_cast<atom_value>(0), // none, e.g., in parity frames
+  atom("ping"),
+  atom("pong"),
+  atom("payload")
+};
+
+constexpr uint8_t num_short_atoms = sizeof(short_atoms)
+                                    / sizeof(short_atoms[0]);
+
+// Returns the one-byte code of `x` or 0.
+uint8_t atom_code(atom_value x) {
+  for (uint8_t i = 0; i < num_short_atoms; ++i)
+    if (short_atoms[i] == x)
+      return i + 1;
+  return 0;
+}
+
+void write_seq(byte_buffer& buf, seq_num x) {
+  for (size_t i = 0; i < seq_size; ++i)
+    buf.push_back(static_cast<char>((x >> ((seq_size - 1 - i) * 8)) & 0xFF));
+}
+
+size_t read_seq(const char* data, seq_num& x) {
+  x = 0;
+  for (size_t i = 0; i < seq_size; ++i)
+    x = (x << 8) | static_cast<unsigned char>(data[i]);
+  return seq_size;
+}
+
+// Reads the varint at `offset` into `x`. Returns `incomplete` if `size` ends
+// within the varint and `malformed` if it exceeds 32 bits.
+decode_status read_varint(const char* data, size_t size, size_t& offset,
+                          uint32_t& x) {
+  uint64_t res = 0;
+  for (unsigned shift = 0; shift < 35; shift += 7) {
+    if (offset >= size)
+      return decode_status::incomplete;
+    auto byte = static_cast<unsigned char>(data[offset++]);
+    res |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      if (res > 0xFFFFFFFF)
+        return decode_status::malformed;
+      x = static_cast<uint32_t>(res);
+      return decode_status::complete;
+    }
+  }
+  return decode_status::malformed;
+}
+
+// Calls `f(gap, span)` for each SACK range of `msg`.
+template <class F>
+void for_each_sack(const reliable_msg& msg, F f) {
+  auto prev = msg.ack_seq;
+  for (auto& x : msg.sacks) {
+    f(static_cast<uint32_t>(x.first - prev - 1),
+      static_cast<uint32_t>(x.last - x.first));
+    prev = x.last;
+  }
+}
+
+// Returns the number of bytes following the `length` field.
+size_t body_size(const reliable_msg& msg) {
+  auto res = seq_size;
+  if (msg.has(has_acks)) {
+    res += seq_size + varint_size(msg.window)
+           + varint_size(static_cast<uint32_t>(msg.sacks.size()));
+    for_each_sack(msg, [&](uint32_t gap, uint32_t span) {
+      res += varint_size(gap) + varint_size(span);
+    });
+  }
+  if (msg.has(has_payload)) {
+    res += varint_size(msg.stream) + 1 + msg.payload.size();
+    if (!msg.has(unordered))
+      res += varint_size(msg.seq - msg.stream_seq);
+    if (atom_code(msg.atm) == 0)
+      res += sizeof(uint64_t);
+    if (msg.has(fragment))
+      res += varint_size(msg.fragment_index)
+             + varint_size(msg.fragment_offset)
+             + varint_size(msg.message_size);
+  }
+  return res;
+}
+
+} // namespace anonymous
+
+size_t write_varint(byte_buffer& buf, uint32_t x) {
+  size_t res = 1;
+  for (; x >= 0x80; x >>= 7, ++res)
+    buf.push_back(static_cast<char>((x & 0x7F) | 0x80));
+  buf.push_back(static_cast<char>(x));
+  return res;
+}
+
+reliable_msg frame_view::to_msg() const {
+  reliable_msg res;
+  res.type = type;
+  res.flags = flags;
+  res.seq = seq;
+  if (has(has_acks)) {
+    res.ack_seq = ack_seq;
+    res.window = window;
+    res.sacks.resize(num_sacks);
+    // decode() checked the ranges already
+    size_t offset = 0;
+    auto prev = ack_seq;
+    for (auto& x : res.sacks) {
+      uint32_t gap = 0;
+      uint32_t span = 0;
+      read_varint(sacks, max_frame_length, offset, gap);
+      read_varint(sacks, max_frame_length, offset, span);
+      x.first = prev + gap + 1;
+      x.last = x.first + span;
+      prev = x.last;
+    }
+  }
+  if (has(has_payload)) {
+    res.stream = stream;
+    res.stream_seq = stream_seq;
+    res.atm = atm;
+    res.fragment_index = fragment_index;
+    res.fragment_offset = fragment_offset;
+    res.message_size = message_size;
+    // copies into a recycled buffer
+    res.payload = shared_payload{payload, payload + payload_size};
+  }
+  return res;
+}
+
+size_t encoded_size(const reliable_msg& msg) {
+  auto body = body_size(msg);
+  return 1 + varint_size(msg.flags)
+         + varint_size(static_cast<uint32_t>(body)) + body;
+}
+
+size_t encode(byte_buffer& buf, const reliable_msg& msg) {
+  auto res = encode_header(buf, msg);
+  if (msg.has(has_payload)) {
+    buf.insert(buf.end(), msg.payload.begin(), msg.payload.end());
+    res += msg.payload.size();
+  }
+  return res;
+}
+
+size_t encode_header(byte_buffer& buf, const reliable_msg& msg) {
+  auto before = buf.size();
+  buf.push_back(static_cast<char>((frame_version << 2)
+                                  | static_cast<uint8_t>(msg.type)));
+  write_varint(buf, msg.flags);
+  write_varint(buf, static_cast<uint32_t>(body_size(msg)));
+  write_seq(buf, msg.seq);
+  if (msg.has(has_acks)) {
+    write_seq(buf, msg.ack_seq);
+    write_varint(buf, msg.window);
+    write_varint(buf, static_cast<uint32_t>(msg.sacks.size()));
+    for_each_sack(msg, [&](uint32_t gap, uint32_t span) {
+      write_varint(buf, gap);
+      write_varint(buf, span);
+    });
+  }
+  if (msg.has(has_payload)) {
+    write_varint(buf, msg.stream);
+    if (!msg.has(unordered))
+      write_varint(buf, msg.seq - msg.stream_seq);
+    auto code = atom_code(msg.atm);
+    buf.push_back(static_cast<char>(code));
+    if (code == 0)
+      write_int(buf, static_cast<uint64_t>(msg.atm));
+    if (msg.has(fragment)) {
+      write_varint(buf, msg.fragment_index);
+      write_varint(buf, msg.fragment_offset);
+      write_varint(buf, msg.message_size);
+    }
+  }
+  return buf.size() - before;
+}
+
+decode_status decode(const char* data, size_t size, frame_view& x) {
+  if (size == 0)
+    return decode_status::incomplete;
+  auto first = static_cast<unsigned char>(data[0]);
+  x.version = static_cast<uint8_t>(first >> 2);
+  auto type = static_cast<uint8_t>(first & 0x03);
+  if (x.version != frame_version
+      || type > static_cast<uint8_t>(frame_type::parity))
+    return decode_status::malformed;
+  x.type = static_cast<frame_type>(type);
+  size_t offset = 1;
+  uint32_t flags = 0;
+  auto res = read_varint(data, size, offset, flags);
+  if (res == decode_status::complete)
+    res = read_varint(data, size, offset, x.length);
+  if (res != decode_status::complete)
+    return res;
+  if (flags > 0xFFFF || x.length > max_frame_length)
+    return decode_status::malformed;
+  x.flags = static_cast<uint16_t>(flags);
+  x.header_size = offset;
+  if (size < x.size())
+    return decode_status::incomplete;
+  auto end = x.size();
+  // all fields must end within the frame
+  auto varint = [&](uint32_t& y) {
+    return read_varint(data, end, offset, y) == decode_status::complete;
+  };
+  auto seq = [&](seq_num& y) {
+    if (end - offset < seq_size)
+      return false;
+    offset += read_seq(data + offset, y);
+    return true;
+  };
+  if (!seq(x.seq))
+    return decode_status::malformed;
+  x.ack_seq = 0;
+  x.window = 0;
+  x.num_sacks = 0;
+  x.sacks = nullptr;
+  if (x.has(has_acks)) {
+    if (!seq(x.ack_seq) || !varint(x.window) || !varint(x.num_sacks))
+      return decode_status::malformed;
+    x.sacks = data + offset;
+    for (uint32_t i = 0; i < x.num_sacks; ++i) {
+      uint32_t gap;
+      uint32_t span;
+      if (!varint(gap) || !varint(span))
+        return decode_status::malformed;
+    }
+  }
+  x.stream = 0;
+  x.stream_seq = 0;
+  x.atm = static_cast<atom_value>(0);
+  x.fragment_index = 0;
+  x.fragment_offset = 0;
+  x.message_size = 0;
+  x.payload = nullptr;
+  x.payload_size = 0;
+  if (x.has(has_payload)) {
+    uint32_t stream = 0;
+    uint32_t distance = 0;
+    if (!varint(stream) || stream > 0xFFFF
+        || (!x.has(unordered) && !varint(distance)) || offset == end)
+      return decode_status::malformed;
+    x.stream = static_cast<uint16_t>(stream);
+    // as truncated as `seq`, restoring `seq` restores both
+    x.stream_seq = x.seq - distance;
+    auto code = static_cast<uint8_t>(data[offset++]);
+    if (code > num_short_atoms) {
+      return decode_status::malformed;
+    } else if (code > 0) {
+      x.atm = short_atoms[code - 1];
+    } else {
+      uint64_t atm;
+      if (end - offset < sizeof(uint64_t))
+        return decode_status::malformed;
+      offset += read_int(data + offset, atm);
+      x.atm = static_cast<atom_value>(atm);
+    }
+    if (x.has(fragment)
+        && (!varint(x.fragment_index) || !varint(x.fragment_offset)
+            || !varint(x.message_size)))
+      return decode_status::malformed;
+    x.payload = data + offset;
+    x.payload_size = end - offset;
+    offset = end;
+    if (x.has(fragment)
+        && (x.fragment_offset > x.message_size
+            || x.message_size - x.fragment_offset < x.payload_size))
+      return decode_status::malformed;
+  }
+  if (offset != end)
+    return decode_status::malformed;
+  return decode_status::complete;
+}
+
+void restore_seqs(reliable_msg& msg, seq_num seq_ref, seq_num ack_ref) {
+  // shift all numbers of a space alike, keeping their distances
+  auto seq = seq_expand(msg.seq, seq_ref, seq_bits);
+  if (!msg.has(unordered))
+    msg.stream_seq += seq - msg.seq;
+  msg.seq = seq;
+  if (msg.has(has_acks)) {
+    auto ack = seq_expand(msg.ack_seq, ack_ref, seq_bits);
+    auto shift = ack - msg.ack_seq;
+    msg.ack_seq = ack;
+    for (auto& x : msg.sacks) {
+      x.first += shift;
+      x.last += shift;
+    }
+  }
+}
+
+} // namespace relm
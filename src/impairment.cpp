@@ -0,0 +1,120 @@
+
+#include <cmath>
+#include <algorithm>
+
+#include "include/impairment.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace relm {
+
+bool parse_loss_model(const string& name, loss_model& x) {
+  if (name == "bernoulli")
+    x = loss_model::bernoulli;
+  else if (name == "gilbert-elliott")
+    x = loss_model::gilbert_elliott;
+  else
+    return false;
+  return true;
+}
+
+bool parse_delay_model(const string& name, delay_model& x) {
+  if (name == "constant")
+    x = delay_model::constant;
+  else if (name == "geometric")
+    x = delay_model::geometric;
+  else if (name == "uniform")
+    x = delay_model::uniform;
+  else
+    return false;
+  return true;
+}
+
+impairment::impairment(const impairment_config& cfg)
+    : cfg_(cfg),
+      gen_(cfg.seed),
+      unit_(0.0, 1.0),
+      bad_state_(false),
+      frames_(0),
+      lost_(0),
+      duplicated_(0),
+      reordered_(0) {
+  // nop
+}
+
+impairment::impairment() : impairment(impairment_config{}) {
+  // nop
+}
+
+impairment::duration impairment::sample_delay(double x) {
+  // maps a uniform sample from [0, 1) to the configured distribution
+  duration scale = cfg_.delay;
+  switch (cfg_.delays) {
+    case delay_model::constant:
+      return scale;
+    case delay_model::geometric: {
+      // number of failures before the first success with p = 0.5
+      auto n = static_cast<duration::rep>(floor(-log2(1.0 - x)));
+      return scale * n;
+    }
+    case delay_model::uniform:
+      return duration{static_cast<duration::rep>(2 * x * scale.count())};
+  }
+  return scale;
+}
+
+impairment::verdict impairment::apply(clock::time_point now, size_t size) {
+  // draw the same number of samples for every frame to keep the decisions
+  // for later frames independent of earlier outcomes
+  auto transition = unit_(gen_);
+  auto loss = unit_(gen_);
+  auto delay = unit_(gen_);
+  auto reorder = unit_(gen_);
+  auto duplicate = unit_(gen_);
+  auto duplicate_delay = unit_(gen_);
+  ++frames_;
+  verdict res;
+  res.copies = 0;
+  res.reordered = false;
+  double loss_rate;
+  if (cfg_.losses == loss_model::gilbert_elliott) {
+    if (bad_state_ ? transition < cfg_.ge_r : transition < cfg_.ge_p)
+      bad_state_ = !bad_state_;
+    loss_rate = bad_state_ ? cfg_.ge_loss_bad : cfg_.ge_loss_good;
+  } else {
+    loss_rate = cfg_.loss_rate;
+  }
+  if (loss < loss_rate) {
+    ++lost_;
+    return res;
+  }
+  // frames queue up behind each other on a link with limited capacity
+  duration queueing{0};
+  if (cfg_.bandwidth > 0) {
+    auto start = max(now, link_free_);
+    auto transfer = duration{static_cast<duration::rep>(
+      size * 1000000 / cfg_.bandwidth)};
+    link_free_ = start + transfer;
+    queueing = duration_cast<duration>(link_free_ - now);
+  }
+  res.delays[0] = queueing;
+  if (cfg_.delay.count() > 0)
+    res.delays[0] += sample_delay(delay);
+  if (reorder < cfg_.reorder_rate) {
+    ++reordered_;
+    res.reordered = true;
+    res.delays[0] += cfg_.reorder_delay;
+  }
+  res.copies = 1;
+  if (duplicate < cfg_.duplicate_rate) {
+    ++duplicated_;
+    res.delays[1] = queueing;
+    if (cfg_.delay.count() > 0)
+      res.delays[1] += sample_delay(duplicate_delay);
+    res.copies = 2;
+  }
+  return res;
+}
+
+} // namespace relm
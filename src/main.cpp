@@ -13,10 +13,13 @@
 #include <caf/io/all.hpp>
 #include <caf/io/middleman.hpp>
 
+#include "include/trace.hpp"
+#include "include/metrics.hpp"
 #include "include/utility.hpp"
 #include "include/ping_pong.hpp"
 #include "include/reliability_actor.hpp"
 #include "include/unreliable_broker.hpp"
+#include "include/datagram_transport.hpp"
 
 using namespace std;
 using namespace caf;
@@ -31,45 +34,187 @@ public:
   uint16_t port = 0;
   std::string host = "localhost";
   bool server_mode = false;
+  std::string transport = "tcp";
+  bool fused = false;
+  size_t batch_size = broker_config{}.batch_size;
+  uint32_t linger_us = broker_config{}.linger.count();
+  impairment_options impairment;
+  size_t window_size = reliability_config{}.window_size;
+  uint32_t initial_rto_ms = reliability_config{}.initial_rto.count();
+  uint32_t min_rto_ms = reliability_config{}.min_rto.count();
+  uint32_t max_rto_ms = reliability_config{}.max_rto.count();
+  uint32_t ack_delay_ms = reliability_config{}.ack_delay.count();
+  uint32_t delivery_delay_ms = reliability_config{}.delivery_delay.count();
+  size_t max_pending_bytes = reliability_config{}.max_pending_bytes;
+  uint32_t initial_seq = reliability_config{}.initial_seq;
+  std::string congestion = "aimd";
+  std::string trace_level = "info";
+  std::string metrics_file;
+  uint32_t metrics_interval_ms = 1000;
 
   config() {
-    opt_group{custom_options_, "global"}
-    .add(port, "port,p", "set port")
+    opt_group grp{custom_options_, "global"};
+    grp.add(port, "port,p", "set port")
     .add(host, "host,H", "set host (ignored in server mode)")
-    .add(server_mode, "server-mode,s", "enable server mode");
+    .add(server_mode, "server-mode,s", "enable server mode")
+    .add(transport, "transport", "set transport (tcp, udp)")
+    .add(fused, "fused", "run the reliability protocol inside the broker")
+    .add(batch_size, "batch-size,b", "set max. frames per write batch")
+    .add(linger_us, "linger,l", "set max. frame delay before flushing (us)")
+    .add(window_size, "window-size,w", "set max. unacknowledged frames")
+    .add(initial_rto_ms, "initial-rto", "set RTO before first RTT sample (ms)")
+    .add(min_rto_ms, "min-rto", "set lower bound for the RTO (ms)")
+    .add(max_rto_ms, "max-rto", "set upper bound for the RTO (ms)")
+    .add(ack_delay_ms, "ack-delay", "set max. delay of standalone acks (ms)")
+    .add(delivery_delay_ms, "delivery-delay",
+         "set hold back time before delivering to the application (ms)")
+    .add(max_pending_bytes, "max-pending-bytes",
+         "set max. bytes handed to the broker but not written (0: no limit)")
+    .add(initial_seq, "initial-seq",
+         "set first sequence number (must match the peer)")
+    .add(congestion, "congestion",
+         "set congestion control algorithm (none, aimd, cubic)")
+    .add(trace_level, "trace-level,t",
+         "set trace level (off, error, warning, info, debug, trace)")
+    .add(metrics_file, "metrics-file",
+         "append metrics to this file periodically (default: off)")
+    .add(metrics_interval_ms, "metrics-interval",
+         "set interval between two metrics dumps (ms)");
+    impairment.add(grp);
+  }
+
+  /// Returns an error description if the impairment options are invalid.
+  std::string broker(broker_config& res) const {
+    res.batch_size = batch_size;
+    res.linger = std::chrono::microseconds{linger_us};
+    res.fused = fused;
+    return impairment.convert(res.impairment);
+  }
+
+  /// Returns an error description if the reliability options are invalid.
+  std::string reliability(reliability_config& res) const {
+    res.window_size = window_size;
+    res.initial_rto = std::chrono::milliseconds{initial_rto_ms};
+    res.min_rto = std::chrono::milliseconds{min_rto_ms};
+    res.max_rto = std::chrono::milliseconds{max_rto_ms};
+    res.ack_delay = std::chrono::milliseconds{ack_delay_ms};
+    res.delivery_delay = std::chrono::milliseconds{delivery_delay_ms};
+    res.max_pending_bytes = max_pending_bytes;
+    res.initial_seq = initial_seq;
+    if (!parse_congestion_algorithm(congestion, res.congestion))
+      return "invalid congestion control algorithm: " + congestion;
+    return {};
   }
 };
 
 void caf_main(actor_system& system, const config& cfg) {
+  auto level = trace::parse_level(cfg.trace_level);
+  if (level < 0) {
+    std::cerr << "invalid trace level: " << cfg.trace_level << endl;
+    return;
+  }
+  if (level > RELM_TRACE_LEVEL)
+    std::cerr << "trace level " << cfg.trace_level << " exceeds the level "
+              << "compiled in, rebuild with a higher RELM_TRACE_LEVEL" << endl;
+  trace::set_level(level);
+  trace::start(std::cerr);
+  relm::transport tp;
+  if (!parse_transport(cfg.transport, tp)) {
+    std::cerr << "invalid transport: " << cfg.transport << endl;
+    return;
+  }
+  if (cfg.fused && tp == relm::transport::udp) {
+    std::cerr << "fused mode requires the TCP transport" << endl;
+    return;
+  }
+  broker_config bcfg;
+  reliability_config rcfg;
+  auto err = cfg.broker(bcfg);
+  if (err.empty())
+    err = cfg.reliability(rcfg);
+  if (!err.empty()) {
+    std::cerr << err << endl;
+    return;
+  }
+  if (tp == relm::transport::udp)
+    fit_to_datagrams(rcfg);
+  cout << "impairment seed: " << bcfg.impairment.seed << endl;
+  actor exporter;
+  if (!cfg.metrics_file.empty())
+    exporter = system.spawn(metrics_exporter, cfg.metrics_file,
+                            std::chrono::milliseconds{
+                              cfg.metrics_interval_ms});
   if (cfg.server_mode) {
     cout << "run in server mode" << endl;
-    auto application = system.spawn(pong);
-    auto reliability = system.spawn(init_reliability_actor, application);
+    if (tp == relm::transport::udp) {
+      // a datagram endpoint serves a single peer
+      auto application = system.spawn(pong);
+      auto reliability = system.spawn(init_reliability_actor, application,
+                                      rcfg);
+      auto port = cfg.port;
+      auto server = spawn_datagram_server(system, port, reliability, bcfg);
+      if (!server) {
+        std::cerr << "failed to spawn server: "
+                  << system.render(server.error()) << endl;
+        anon_send_exit(application, exit_reason::user_shutdown);
+        anon_send_exit(reliability, exit_reason::user_shutdown);
+        if (exporter)
+          anon_send_exit(exporter, exit_reason::user_shutdown);
+        return;
+      }
+      cout << "listening on UDP port " << port << endl;
+      print_on_exit(*server, "server");
+      return;
+    }
+    app_factory make_app = [](actor_system& sys) {
+      return sys.spawn(pong);
+    };
     auto server = system.middleman().spawn_server(relm::server, cfg.port,
-                                                  reliability);
+                                                  make_app, rcfg, bcfg);
     if (!server) {
       std::cerr << "failed to spawn server: "
                 << system.render(server.error()) << endl;
+      if (exporter)
+        anon_send_exit(exporter, exit_reason::user_shutdown);
       return;
     }
-    print_on_exit(reliability, "reliability");
-    print_on_exit(application, "application");
     print_on_exit(*server, "server");
     return;
   }
   auto application = system.spawn(ping, size_t{PING_PONGS});
-  auto reliability = system.spawn(init_reliability_actor, application);
-  auto client = system.middleman().spawn_client(broker_impl, cfg.host,
-                                                cfg.port, reliability);
+  // in fused mode, the broker runs the protocol and talks to the application
+  actor reliability;
+  expected<actor> client = make_error(sec::cannot_connect_to_node);
+  if (cfg.fused) {
+    client = system.middleman().spawn_client(fused_broker, cfg.host,
+                                             cfg.port, application, rcfg,
+                                             bcfg);
+  } else {
+    reliability = system.spawn(init_reliability_actor, application, rcfg);
+    client = tp == relm::transport::udp
+             ? spawn_datagram_client(system, cfg.host, cfg.port, reliability,
+                                     bcfg)
+             : system.middleman().spawn_client(broker_impl, cfg.host,
+                                               cfg.port, reliability, bcfg);
+  }
   if (!client) {
     std::cerr << "failed to spawn client: "
                << system.render(client.error()) << endl;
+    if (exporter)
+      anon_send_exit(exporter, exit_reason::user_shutdown);
     return;
   }
+  // the dump stops with the ping pong
+  if (exporter)
+    application->attach_functor([=](const error&) {
+      anon_send_exit(exporter, exit_reason::user_shutdown);
+    });
   print_on_exit(application, "application");
-  print_on_exit(reliability, "reliability");
+  if (reliability)
+    print_on_exit(reliability, "reliability");
   print_on_exit(*client, "client");
-  send_as(reliability, application, kickoff_atom::value, reliability);
+  auto out = cfg.fused ? *client : reliability;
+  send_as(out, application, kickoff_atom::value, out);
 }
 
 } // namespace anonymous
@@ -0,0 +1,228 @@
+
+#include <mutex>
+#include <fstream>
+#include <utility>
+#include <algorithm>
+
+#include "include/metrics.hpp"
+
+using namespace std;
+using namespace std::chrono;
+using namespace caf;
+
+namespace relm {
+
+namespace {
+
+using counter_member = counter session_metrics::*;
+using gauge_member = gauge session_metrics::*;
+using histogram_member = histogram session_metrics::*;
+
+const pair<const char*, counter_member> counters[] = {
+  {"data_sent", &session_metrics::data_sent},
+  {"retransmitted", &session_metrics::retransmitted},
+  {"data_received", &session_metrics::data_received},
+  {"duplicates", &session_metrics::duplicates},
+  {"out_of_order", &session_metrics::out_of_order},
+  {"acks_sent", &session_metrics::acks_sent},
+  {"acks_received", &session_metrics::acks_received},
+  {"bytes_sent", &session_metrics::bytes_sent},
+  {"bytes_received", &session_metrics::bytes_received}
+};
+
+const pair<const char*, gauge_member> gauges[] = {
+  {"outbox", &session_metrics::outbox},
+  {"inbox", &session_metrics::inbox},
+  {"ready", &session_metrics::ready},
+  {"output", &session_metrics::output}
+};
+
+const pair<const char*, histogram_member> histograms[] = {
+  {"rtt_us", &session_metrics::rtt},
+  {"ack_delay_us", &session_metrics::ack_delay}
+};
+
+constexpr size_t num_counters = sizeof(counters) / sizeof(counters[0]);
+constexpr size_t num_gauges = sizeof(gauges) / sizeof(gauges[0]);
+constexpr size_t num_histograms = sizeof(histograms) / sizeof(histograms[0]);
+
+// Sums of the metrics of several sessions.
+struct totals {
+  uint64_t counter_sums[num_counters];
+  uint64_t gauge_sums[num_gauges];
+  vector<uint64_t> histogram_sums[num_histograms];
+
+  totals() {
+    fill(begin(counter_sums), end(counter_sums), 0);
+    fill(begin(gauge_sums), end(gauge_sums), 0);
+    for (auto& xs : histogram_sums)
+      xs.resize(histogram::num_buckets, 0);
+  }
+
+  void add(const session_metrics& x, bool with_gauges) {
+    for (size_t i = 0; i < num_counters; ++i)
+      counter_sums[i] += (x.*counters[i].second).get();
+    if (with_gauges)
+      for (size_t i = 0; i < num_gauges; ++i)
+        gauge_sums[i] += (x.*gauges[i].second).get();
+    for (size_t i = 0; i < num_histograms; ++i)
+      (x.*histograms[i].second).add_to(histogram_sums[i]);
+  }
+
+  metrics_map to_map() const {
+    metrics_map res;
+    for (size_t i = 0; i < num_counters; ++i)
+      res.emplace(counters[i].first, counter_sums[i]);
+    for (size_t i = 0; i < num_gauges; ++i)
+      res.emplace(gauges[i].first, gauge_sums[i]);
+    for (size_t i = 0; i < num_histograms; ++i)
+      export_histogram(histograms[i].first, histogram_sums[i], res);
+    return res;
+  }
+};
+
+// Running sessions plus the totals of all finished ones. Only registering
+// and querying lock, recording never does.
+struct registry {
+  mutex mtx;
+  vector<const session_metrics*> sessions;
+  totals finished;
+};
+
+registry& metrics_registry() {
+  static registry instance;
+  return instance;
+}
+
+} // namespace anonymous
+
+constexpr size_t histogram::sub_bucket_bits;
+constexpr size_t histogram::num_buckets;
+
+histogram::histogram() : buckets_(num_buckets) {
+  // nop
+}
+
+void histogram::add_to(vector<uint64_t>& xs) const {
+  for (size_t i = 0; i < num_buckets; ++i)
+    xs[i] += buckets_[i].get();
+}
+
+size_t histogram::index(uint64_t x) {
+  constexpr uint64_t sub_buckets = uint64_t{1} << sub_bucket_bits;
+  if (x < sub_buckets)
+    return static_cast<size_t>(x);
+  // position of the highest bit, the next bits select the sub bucket
+  auto e = static_cast<size_t>(63 - __builtin_clzll(x));
+  auto sub = static_cast<size_t>(x >> (e - sub_bucket_bits)) - sub_buckets;
+  return ((e - sub_bucket_bits + 1) << sub_bucket_bits) + sub;
+}
+
+uint64_t histogram::lowest(size_t i) {
+  constexpr size_t sub_buckets = size_t{1} << sub_bucket_bits;
+  if (i < sub_buckets)
+    return i;
+  auto e = (i >> sub_bucket_bits) + sub_bucket_bits - 1;
+  auto sub = i & (sub_buckets - 1);
+  return static_cast<uint64_t>(sub_buckets + sub) << (e - sub_bucket_bits);
+}
+
+void export_histogram(const string& name, const vector<uint64_t>& xs,
+                      metrics_map& res) {
+  uint64_t count = 0;
+  for (auto x : xs)
+    count += x;
+  res[name + "_count"] = count;
+  // reports the highest value of the bucket holding the quantile
+  auto highest = [](size_t i) {
+    return i + 1 < histogram::num_buckets ? histogram::lowest(i + 1) - 1
+                                          : UINT64_MAX;
+  };
+  const pair<const char*, double> quantiles[] = {
+    {"_p50", 0.5}, {"_p90", 0.9}, {"_p99", 0.99}, {"_p999", 0.999}
+  };
+  for (auto& q : quantiles) {
+    uint64_t value = 0;
+    if (count > 0) {
+      auto rank = static_cast<uint64_t>(q.second * count);
+      uint64_t seen = 0;
+      for (size_t i = 0; i < xs.size(); ++i) {
+        seen += xs[i];
+        if (seen > rank) {
+          value = highest(i);
+          break;
+        }
+      }
+    }
+    res[name + q.first] = value;
+  }
+  uint64_t max_value = 0;
+  for (size_t i = xs.size(); i > 0; --i) {
+    if (xs[i - 1] > 0) {
+      max_value = highest(i - 1);
+      break;
+    }
+  }
+  res[name + "_max"] = max_value;
+}
+
+session_metrics::session_metrics() {
+  auto& r = metrics_registry();
+  unique_lock<mutex> guard{r.mtx};
+  r.sessions.push_back(this);
+}
+
+session_metrics::~session_metrics() {
+  auto& r = metrics_registry();
+  unique_lock<mutex> guard{r.mtx};
+  r.finished.add(*this, false);
+  r.sessions.erase(find(r.sessions.begin(), r.sessions.end(), this));
+}
+
+metrics_map session_metrics::snapshot() const {
+  totals res;
+  res.add(*this, true);
+  return res.to_map();
+}
+
+metrics_map global_metrics() {
+  auto& r = metrics_registry();
+  totals res;
+  {
+    unique_lock<mutex> guard{r.mtx};
+    res = r.finished;
+    for (auto x : r.sessions)
+      res.add(*x, true);
+  }
+  return res.to_map();
+}
+
+void write_metrics(ostream& out, const metrics_map& xs) {
+  out << "# " << duration_cast<milliseconds>(
+                   system_clock::now().time_since_epoch()).count()
+      << '\n';
+  for (auto& kvp : xs)
+    out << kvp.first << ' ' << kvp.second << '\n';
+  out.flush();
+}
+
+behavior metrics_exporter(event_based_actor* self, const string& path,
+                          milliseconds interval) {
+  auto out = std::make_shared<ofstream>(path, ios::app);
+  if (!*out)
+    aout(self) << "[M] Cannot open " << path << " for writing." << endl;
+  if (interval.count() > 0)
+    self->delayed_send(self, interval, dump_atom::value);
+  return {
+    [=](dump_atom) {
+      if (*out)
+        write_metrics(*out, global_metrics());
+      self->delayed_send(self, interval, dump_atom::value);
+    },
+    [=](metrics_atom) {
+      return global_metrics();
+    }
+  };
+}
+
+} // namespace relm
@@ -0,0 +1,34 @@
+#include <utility>
+
+#include "include/output_scheduler.hpp"
+
+namespace relm {
+
+output_scheduler::output_scheduler(size_t max_pending_bytes)
+    : max_pending_{max_pending_bytes},
+      pending_{0},
+      written_while_draining_{0},
+      draining_{false} {
+  // nop
+}
+
+void output_scheduler::push(traffic_class cls, reliable_msg msg) {
+  queues_[static_cast<size_t>(cls)].push_back(std::move(msg));
+}
+
+void output_scheduler::written(size_t n) {
+  // drain() adds the bytes of the current frame only after `f` returns
+  if (draining_)
+    written_while_draining_ += n;
+  else
+    take_off(n);
+}
+
+size_t output_scheduler::size() const {
+  size_t res = 0;
+  for (auto& queue : queues_)
+    res += queue.size();
+  return res;
+}
+
+} // namespace relm
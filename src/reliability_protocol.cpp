@@ -0,0 +1,657 @@
+#include <utility>
+#include <iterator>
+#include <algorithm>
+
+#include "include/trace.hpp"
+#include "include/framing.hpp"
+#include "include/reliability_protocol.hpp"
+
+using namespace caf;
+using namespace std;
+using namespace std::chrono;
+
+namespace relm {
+
+namespace {
+const auto tick_interval = milliseconds(10);
+const size_t ack_interval_count = 10;
+// number of frames SACKed above a gap before it counts as lost
+const uint32_t dup_threshold = 3;
+// data frames between two adaptions of the FEC group size
+const uint64_t fec_adapt_interval = 256;
+
+// Records how long the oldest unacked data frame waited for this ack.
+void ack_sent(reliability_state& state) {
+  if (!state.ack_pending)
+    return;
+  state.ack_pending = false;
+  auto delay = clk::now() - state.ack_pending_since;
+  state.metrics.ack_delay.record(
+    static_cast<uint64_t>(duration_cast<microseconds>(delay).count()));
+}
+
+// Returns the current retransmission timeout in timer wheel ticks.
+size_t rto_ticks(const reliability_state& state) {
+  auto rto = state.rtt.rto();
+  auto tick = duration_cast<rto_estimator::duration>(tick_interval);
+  return static_cast<size_t>((rto + tick - rto_estimator::duration{1}) / tick);
+}
+
+// Returns the delivery policy for messages with the atom `atm`.
+delivery_policy policy_of(const reliability_state& state, atom_value atm) {
+  auto i = state.policies.find(atm);
+  return i != state.policies.end() ? i->second : delivery_policy{};
+}
+
+// Checks whether a frame fits into the reassembly buffers. Only a fragment
+// starting a new message takes memory. Beyond the budget, only the next frame
+// of the session may start one, no other frame can hold it back.
+bool fits_reassembly(const reliability_state& st, const reliable_msg& msg) {
+  if (!msg.has(fragment) || seq_le(msg.seq, st.inbox.next() - 1))
+    return true;
+  if (msg.message_size > st.max_message_size)
+    return false;
+  if (st.reassembly.count(msg.seq - msg.fragment_index) > 0)
+    return true;
+  return st.reassembly_bytes + msg.message_size <= st.max_message_size
+         || (msg.seq == st.inbox.next()
+             && st.reassembly_bytes <= st.max_message_size);
+}
+
+// Allocates the buffer for the message of an accepted fragment.
+void reserve_reassembly(reliability_state& st, const reliable_msg& msg) {
+  auto& x = st.reassembly[msg.seq - msg.fragment_index];
+  if (x.buf)
+    return;
+  x.buf = make_buffer();
+  x.buf->bytes.resize(msg.message_size);
+  st.reassembly_bytes += msg.message_size;
+}
+
+// Picks the FEC group size from the share of retransmitted frames since the
+// last adaption.
+void adapt_fec(reliability_state& st) {
+  auto retransmissions = st.metrics.retransmitted.get();
+  auto transmissions = st.metrics.data_sent.get() + retransmissions;
+  auto sent = transmissions - st.fec_transmissions;
+  if (!st.fec_adaptive || sent < fec_adapt_interval)
+    return;
+  auto lost = retransmissions - st.fec_retransmissions;
+  st.fec_out.group_size(
+    adapt_fec_group_size(static_cast<double>(lost) / sent));
+  st.fec_transmissions = transmissions;
+  st.fec_retransmissions = retransmissions;
+}
+
+// Checks whether both the send window and the congestion window have room
+// for another frame.
+bool can_send(const reliability_state& state) {
+  auto& outbox = state.outbox;
+  if (outbox.full()
+      || static_cast<double>(outbox.outstanding()) >= state.cc->cwnd())
+    return false;
+  // with nothing in flight, a frame beyond the peer's window probes for a
+  // window update that might have been lost
+  return seq_le(outbox.next(), state.peer_limit)
+         || outbox.outstanding() == 0;
+}
+
+} // namespace anonymous
+
+uint32_t receive_window(const reliability_state& state) {
+  auto capacity = state.inbox.capacity();
+  auto used = state.ready.size();
+  return used < capacity ? static_cast<uint32_t>(capacity - used) : 0;
+}
+
+reliable_msg create_ack_msg(reliability_state& state) {
+  ack_sent(state);
+  // cumulative ack plus the ranges buffered above it
+  auto& inbox = state.inbox;
+  state.unacked = inbox.size();
+  auto res = reliable_msg::ack(inbox.next() - 1, inbox.ranges(max_sack_ranges));
+  res.window = state.advertised = receive_window(state);
+  return res;
+}
+
+void piggyback_acks(reliability_state& state, reliable_msg& msg) {
+  ack_sent(state);
+  auto& inbox = state.inbox;
+  msg.flags |= has_acks;
+  msg.ack_seq = inbox.next() - 1;
+  msg.window = state.advertised = receive_window(state);
+  if (inbox.empty())
+    msg.sacks.clear();
+  else
+    msg.sacks = inbox.ranges(max_sack_ranges);
+  state.unacked = inbox.size();
+}
+
+void reliability_protocol::init(const reliability_config& cfg) {
+  auto& st = state_;
+  // a larger window breaks restoring sequence numbers from their low bits
+  auto window_size = min(cfg.window_size, max_window_size);
+  st.initial_seq = cfg.initial_seq;
+  st.outbox = send_window{window_size, cfg.initial_seq};
+  st.inbox = reorder_buffer{window_size, cfg.initial_seq};
+  st.retransmits = timer_wheel{window_size};
+  st.rtt = rto_estimator{cfg.initial_rto, cfg.min_rto, cfg.max_rto,
+                         tick_interval};
+  st.delivery_delay = cfg.delivery_delay;
+  st.batch_delivery = cfg.batch_delivery;
+  // the peer drops frames above max_frame_length as malformed, including
+  // parity frames carrying a whole member with its header plus the member
+  // list. FEC may start at runtime, hence the limit always leaves room.
+  auto max_fragment_size = max_frame_length - 2 * max_header_size
+                           - max_parity_overhead;
+  st.max_fragment_size = cfg.max_fragment_size == 0
+                           ? max_fragment_size
+                           : min(cfg.max_fragment_size, max_fragment_size);
+  st.max_message_size = cfg.max_message_size;
+  st.ack_delay = cfg.ack_delay;
+  st.cc = make_congestion_controller(cfg.congestion, window_size);
+  st.credit = cfg.initial_credit;
+  st.unlimited_credit = cfg.initial_credit == 0;
+  st.policies = cfg.policies;
+  st.fec_adaptive = cfg.fec.adaptive;
+  auto group_size = cfg.fec.group_size;
+  if (group_size == 0 && cfg.fec.adaptive)
+    group_size = max_fec_group_size;
+  st.fec_out = fec_encoder{group_size};
+  st.output = output_scheduler{cfg.max_pending_bytes};
+  // assume the peer buffers as many frames as we do until it acks
+  st.peer_ack = cfg.initial_seq - 1;
+  st.peer_limit = cfg.initial_seq + static_cast<seq_num>(window_size) - 1;
+  st.recover = cfg.initial_seq - 1;
+}
+
+void reliability_protocol::start(protocol_hooks hooks, actor_id id) {
+  hooks_ = move(hooks);
+  id_ = id;
+  hooks_.schedule(protocol_timer::tick, tick_interval);
+}
+
+// Hands in-order frames to the application as long as it has credit.
+void reliability_protocol::deliver_ready() {
+  auto& st = state_;
+  auto n = st.ready.size();
+  if (!st.unlimited_credit)
+    n = min(n, static_cast<size_t>(st.credit));
+  if (n == 0)
+    return;
+  if (!st.unlimited_credit)
+    st.credit -= n;
+  if (!st.batch_delivery || n == 1) {
+    for (size_t i = 0; i < n; ++i) {
+      hooks_.deliver(st.ready.front(), st.delivery_delay);
+      st.ready.pop_front();
+    }
+    return;
+  }
+  // a filled gap releases everything buffered behind it in one message
+  vector<reliable_msg> batch;
+  batch.reserve(n);
+  for (size_t i = 0; i < n; ++i) {
+    batch.emplace_back(move(st.ready.front()));
+    st.ready.pop_front();
+  }
+  hooks_.deliver_batch(move(batch), st.delivery_delay);
+}
+
+// Moves a frame to `ready`, a fragment only completes its message. All
+// fragments of a message are acked before it leaves the protocol.
+void reliability_protocol::make_ready(reliable_msg msg) {
+  auto& st = state_;
+  if (!msg.has(fragment)) {
+    st.ready.push_back(move(msg));
+    return;
+  }
+  auto id = msg.seq - msg.fragment_index;
+  // the buffer was reserved when the fragment arrived
+  auto& x = st.reassembly[id];
+  auto& bytes = x.buf->bytes;
+  if (msg.message_size != bytes.size()) {
+    // conflicts with the other fragments of the message
+    return;
+  }
+  copy(msg.payload.begin(), msg.payload.end(),
+       bytes.begin() + static_cast<ptrdiff_t>(msg.fragment_offset));
+  x.received += msg.payload.size();
+  if (x.received < bytes.size())
+    return;
+  auto res = reliable_msg::msg(msg.atm, shared_payload{move(x.buf)}, id);
+  res.stream = msg.stream;
+  st.reassembly_bytes -= bytes.size();
+  st.reassembly.erase(id);
+  st.ready.push_back(move(res));
+}
+
+// Orders a new frame within its stream and moves it to `ready` together with
+// all buffered successors, a gap in one stream holds back no other stream.
+void reliability_protocol::receive_in_stream(reliable_msg msg) {
+  auto& st = state_;
+  auto i = st.stream_inboxes.find(msg.stream);
+  if (i == st.stream_inboxes.end())
+    i = st.stream_inboxes.emplace(msg.stream,
+                                  reorder_buffer{st.inbox.capacity(),
+                                                 st.initial_seq}).first;
+  auto& inbox = i->second;
+  auto seq = msg.seq;
+  auto stream_seq = msg.stream_seq;
+  // the session inbox filters duplicates, each frame arrives here once
+  if (inbox.insert(stream_seq, move(msg)) != reorder_buffer::accepted)
+    return;
+  if (stream_seq != inbox.next())
+    RELM_TRACE(DEBUG, trace::received_early, id_, seq, inbox.next());
+  inbox.drain([&](reliable_msg& x) {
+    if (x.has(abandoned)) {
+      RELM_TRACE(DEBUG, trace::skipped, id_, x.seq);
+      return;
+    }
+    RELM_TRACE(DEBUG, trace::received, id_, x.seq);
+    make_ready(move(x));
+  });
+}
+
+// Drops the payload of a partially reliable frame once its lifetime or its
+// transmissions are exhausted. The frame stays in the outbox without payload
+// and tells the receiver to skip it.
+void reliability_protocol::abandon_if_expired(send_window::entry& x) {
+  if (x.msg.has(abandoned)
+      || ((x.max_transmissions == 0 || x.transmissions < x.max_transmissions)
+          && clk::now() < x.expires_at))
+    return;
+  RELM_TRACE(DEBUG, trace::abandoned, id_, x.msg.seq, x.transmissions);
+  x.msg.flags = static_cast<uint16_t>((x.msg.flags | abandoned)
+                                      & ~scalar_payload);
+  x.msg.payload.clear();
+  state_.abandonments += 1;
+}
+
+// Queues a frame for the wire, flush_output() arms its retransmission
+// timer once the frame leaves the queue.
+void reliability_protocol::put_on_wire(send_window::entry& x) {
+  x.transmissions += 1;
+  auto& metrics = state_.metrics;
+  auto cls = traffic_class::data;
+  if (x.transmissions > 1) {
+    metrics.retransmitted.add();
+    cls = traffic_class::retransmit;
+  } else {
+    metrics.data_sent.add();
+  }
+  state_.output.push(cls, x.msg);
+  reliable_msg parity;
+  if (state_.fec_out.add(x.msg, parity)) {
+    state_.parity_frames += 1;
+    state_.output.push(traffic_class::data, move(parity));
+  }
+  flush_output();
+}
+
+// Assigns the next sequence number to `msg` and sends it, requires space
+// in the outbox.
+void reliability_protocol::transmit(reliable_msg msg) {
+  auto& st = state_;
+  auto policy = policy_of(st, msg.atm);
+  // unordered frames bypass the stream and do not take a position in it
+  if (policy.ordered) {
+    // emplace() allocates a node even for streams already present
+    auto i = st.stream_seqs.find(msg.stream);
+    if (i == st.stream_seqs.end())
+      i = st.stream_seqs.emplace(msg.stream, st.initial_seq).first;
+    msg.stream_seq = i->second++;
+  }
+  else
+    msg.flags |= unordered;
+  // a message is only of use as a whole, fragments are never abandoned
+  auto partially_reliable = !msg.has(fragment);
+  auto& stored = st.outbox.push(move(msg));
+  if (partially_reliable) {
+    if (policy.lifetime.count() > 0)
+      stored.expires_at = clk::now() + policy.lifetime;
+    stored.max_transmissions = policy.max_transmissions;
+  }
+  stored.probe = seq_gt(stored.msg.seq, st.peer_limit);
+  RELM_TRACE(DEBUG, trace::sent, id_, stored.msg.seq,
+             static_cast<int64_t>(stored.msg.payload.size()));
+  put_on_wire(stored);
+}
+
+void reliability_protocol::send(reliable_msg msg) {
+  auto max_size = state_.max_fragment_size;
+  auto size = msg.payload.size();
+  if (size <= max_size || msg.has(scalar_payload)) {
+    send_frame(move(msg));
+    return;
+  }
+  // consecutive frames, the receiver finds the first fragment by the index
+  uint32_t index = 0;
+  for (size_t offset = 0; offset < size; offset += max_size) {
+    auto n = min(max_size, size - offset);
+    auto x = reliable_msg::msg(msg.atm, msg.payload.slice(offset, n));
+    x.flags |= fragment;
+    x.stream = msg.stream;
+    x.fragment_index = index++;
+    x.fragment_offset = static_cast<uint32_t>(offset);
+    x.message_size = static_cast<uint32_t>(size);
+    send_frame(move(x));
+  }
+}
+
+void reliability_protocol::send_frame(reliable_msg msg) {
+  auto& backlog = state_.backlog;
+  if (backlog.empty() && can_send(state_)) {
+    transmit(move(msg));
+    return;
+  }
+  // window exhausted, hold the message back until acks make room
+  if (backlog.empty()) {
+    RELM_TRACE(INFO, trace::paused, id_, 0,
+               static_cast<int64_t>(state_.outbox.size()));
+    hooks_.backpressure(true);
+  }
+  backlog.push_back(move(msg));
+}
+
+void reliability_protocol::drain_backlog() {
+  auto& backlog = state_.backlog;
+  if (backlog.empty())
+    return;
+  while (!backlog.empty() && can_send(state_)) {
+    transmit(move(backlog.front()));
+    backlog.pop_front();
+  }
+  if (backlog.empty()) {
+    RELM_TRACE(INFO, trace::resumed, id_);
+    hooks_.backpressure(false);
+  }
+}
+
+// Resends the frames in the gaps between SACK ranges that have at least
+// `dup_threshold` SACKed frames above them, once per retransmission timeout.
+void reliability_protocol::fast_retransmit(const reliable_msg& ack) {
+  auto& sacks = ack.sacks;
+  uint32_t sacked_above = 0;
+  for (auto i = sacks.size(); i > 0; --i) {
+    sacked_above += sacks[i - 1].last - sacks[i - 1].first + 1;
+    if (sacked_above < dup_threshold)
+      continue;
+    auto gap_first = i > 1 ? sacks[i - 2].last + 1 : ack.ack_seq + 1;
+    for (auto seq = gap_first; seq_lt(seq, sacks[i - 1].first); ++seq) {
+      auto ptr = state_.outbox.find(seq);
+      if (ptr == nullptr || ptr->fast_retransmitted)
+        continue;
+      RELM_TRACE(DEBUG, trace::fast_retransmitted, id_, seq);
+      auto& st = state_;
+      if (seq_gt(seq, st.recover)) {
+        // first loss in this window of data, enter fast recovery
+        st.cc->on_loss(congestion_controller::clock::now());
+        st.recover = st.outbox.next() - 1;
+        st.in_recovery = true;
+        st.loss_events += 1;
+        RELM_TRACE(DEBUG, trace::cwnd_reduced, id_, seq,
+                   static_cast<int64_t>(st.cc->cwnd()),
+                   static_cast<int64_t>(st.cc->ssthresh()));
+      }
+      ptr->fast_retransmitted = true;
+      abandon_if_expired(*ptr);
+      put_on_wire(*ptr);
+    }
+  }
+}
+
+void reliability_protocol::send_acks() {
+  // a queued ack takes the latest state when it leaves the scheduler, one
+  // is enough
+  auto& output = state_.output;
+  if (output.queued(traffic_class::control) == 0)
+    output.push(traffic_class::control, reliable_msg::ack(-1));
+  flush_output();
+}
+
+// Writes queued frames by precedence while the host has room for them.
+void reliability_protocol::flush_output() {
+  auto& st = state_;
+  st.output.drain([&](traffic_class cls, reliable_msg& msg) -> size_t {
+    if (cls == traffic_class::control) {
+      msg = create_ack_msg(st);
+      RELM_TRACE(DEBUG, trace::ack_sent, id_, msg.ack_seq,
+                 static_cast<int64_t>(msg.sacks.size()));
+      st.metrics.acks_sent.add();
+    } else if (msg.type != frame_type::parity) {
+      // skip frames acked while waiting, e.g., after a spurious timeout
+      auto ptr = st.outbox.find(msg.seq);
+      if (ptr == nullptr)
+        return 0;
+      // measure the RTT and the RTO from here, not from the time we queued
+      // the frame
+      ptr->sent_at = clk::now();
+      st.retransmits.arm(msg.seq, rto_ticks(st));
+      // every data frame carries our current ack, making a pending
+      // standalone ack obsolete
+      piggyback_acks(st, msg);
+    }
+    auto size = encoded_size(msg);
+    st.metrics.bytes_sent.add(size);
+    hooks_.write(msg);
+    return size;
+  });
+}
+
+// Sends a standalone ack unless outgoing data piggybacks it within
+// `ack_delay`.
+void reliability_protocol::schedule_acks() {
+  auto& st = state_;
+  if (st.ack_delay.count() == 0) {
+    send_acks();
+  } else if (!st.ack_timer_set) {
+    st.ack_timer_set = true;
+    hooks_.schedule(protocol_timer::ack, st.ack_delay);
+  }
+}
+
+void reliability_protocol::handle_ack(const reliable_msg& msg) {
+  // ack all <= seq and everything in the SACK ranges
+  RELM_TRACE(DEBUG, trace::ack_received, id_, msg.ack_seq,
+             static_cast<int64_t>(msg.sacks.size()));
+  auto& retransmits = state_.retransmits;
+  // sample the RTT from the most recently sent frame this ack covers,
+  // skipping retransmitted frames as their ack is ambiguous (Karn)
+  auto sampled = false;
+  tp newest_sent_at;
+  size_t acked_frames = 0;
+  auto cancel = [&](send_window::entry& acked) {
+    ++acked_frames;
+    retransmits.cancel(acked.msg.seq);
+    if (acked.transmissions == 1
+        && (!sampled || acked.sent_at > newest_sent_at)) {
+      sampled = true;
+      newest_sent_at = acked.sent_at;
+    }
+  };
+  auto& outbox = state_.outbox;
+  outbox.ack(msg.ack_seq, cancel);
+  for (auto& x : msg.sacks)
+    outbox.sack(x.first, x.last, cancel);
+  auto& st = state_;
+  // acks may arrive out of order, only the latest moves the peer's window
+  if (seq_ge(msg.ack_seq, st.peer_ack)) {
+    st.peer_ack = msg.ack_seq;
+    st.peer_limit = msg.ack_seq + msg.window;
+  }
+  if (sampled) {
+    auto rtt = clk::now() - newest_sent_at;
+    st.rtt.sample(duration_cast<rto_estimator::duration>(rtt));
+    st.metrics.rtt.record(
+      static_cast<uint64_t>(duration_cast<microseconds>(rtt).count()));
+  }
+  if (st.in_recovery && seq_ge(msg.ack_seq, st.recover))
+    st.in_recovery = false;
+  if (acked_frames > 0 && !st.in_recovery)
+    st.cc->on_ack(acked_frames, congestion_controller::clock::now(),
+                  st.rtt.srtt());
+  fast_retransmit(msg);
+  drain_backlog();
+}
+
+void reliability_protocol::tick() {
+  // a single periodic timer drives all retransmission timeouts
+  auto& st = state_;
+  auto& outbox = st.outbox;
+  auto& rtt = st.rtt;
+  auto backed_off = false;
+  st.retransmits.tick([&](seq_num seq) {
+    auto ptr = outbox.find(seq);
+    if (ptr != nullptr) {
+      // the receiver drops probes beyond its window, a slow consumer is no
+      // reason to back off or to shrink the congestion window
+      auto probe = ptr->probe;
+      ptr->probe = seq_gt(seq, st.peer_limit);
+      // back off once per tick, not once per expired frame
+      if (!probe && !backed_off) {
+        rtt.backoff();
+        backed_off = true;
+        // collapse the congestion window, frames sent before the
+        // timeout must not trigger another reduction
+        st.cc->on_timeout(congestion_controller::clock::now());
+        st.recover = outbox.next() - 1;
+        st.in_recovery = false;
+        st.timeouts += 1;
+        RELM_TRACE(DEBUG, trace::cwnd_reduced, id_, seq,
+                   static_cast<int64_t>(st.cc->cwnd()),
+                   static_cast<int64_t>(st.cc->ssthresh()));
+      }
+      ptr->fast_retransmitted = false;
+      abandon_if_expired(*ptr);
+      put_on_wire(*ptr);
+      RELM_TRACE(DEBUG, trace::retransmitted, id_, seq, ptr->transmissions,
+                 duration_cast<milliseconds>(rtt.rto()).count());
+    }
+  });
+  adapt_fec(st);
+  st.metrics.outbox.set(outbox.size());
+  st.metrics.inbox.set(st.inbox.size());
+  st.metrics.ready.set(st.ready.size());
+  st.metrics.output.set(st.output.size());
+  hooks_.schedule(protocol_timer::tick, tick_interval);
+}
+
+void reliability_protocol::ack_timeout() {
+  // delayed ack timer, nothing to do if data frames carried the ack
+  state_.ack_timer_set = false;
+  if (state_.unacked > 0)
+    send_acks();
+}
+
+void reliability_protocol::written(size_t n) {
+  state_.output.written(n);
+  flush_output();
+}
+
+void reliability_protocol::receive(reliable_msg& msg) {
+  auto& st = state_;
+  // frames carry the low bits of their sequence numbers only, ours are close
+  // to the outbox and the peer's to the inbox
+  restore_seqs(msg, st.inbox.next(), st.outbox.next());
+  st.metrics.bytes_received.add(encoded_size(msg));
+  handle_frame(msg);
+}
+
+// Processes a received frame, frames restored from parity skip receive()
+// since their bytes never arrived.
+void reliability_protocol::handle_frame(reliable_msg& msg) {
+  auto& st = state_;
+  if (msg.type == frame_type::parity) {
+    // remember data frames from now on, restored ones arrive as if they
+    // were received
+    st.fec_active = true;
+    reliable_msg restored;
+    if (st.fec_in.recover(msg, restored)) {
+      st.recovered += 1;
+      RELM_TRACE(DEBUG, trace::recovered, id_, restored.seq);
+      handle_frame(restored);
+    }
+    return;
+  }
+  // Incoming message, data frames may carry acks as well
+  if (msg.has(has_acks)) {
+    // --> CONTROL
+    st.metrics.acks_received.add();
+    handle_ack(msg);
+  }
+  if (msg.type != frame_type::data)
+    return;
+  // --> APPLICATION
+  if (st.fec_active)
+    st.fec_in.add(msg);
+  st.metrics.data_received.add();
+  if (!st.ack_pending) {
+    st.ack_pending = true;
+    st.ack_pending_since = clk::now();
+  }
+  st.unacked += 1;
+  auto& inbox = st.inbox;
+  auto seq = msg.seq;
+  // beyond the advertised window, e.g., a probe while the application holds
+  // back credit, or no memory left for reassembling its message
+  auto limit = inbox.next() - 1 + receive_window(st);
+  // the session inbox only keeps track of sequence numbers for acks
+  auto res = seq_gt(seq, limit) || !fits_reassembly(st, msg)
+               ? reorder_buffer::beyond_window
+               : inbox.insert(seq, reliable_msg{});
+  switch (res) {
+    case reorder_buffer::old:
+      RELM_TRACE(DEBUG, trace::received_old, id_, seq, inbox.next());
+      // Sender did not receive ack yet, will be acked automatically
+      st.metrics.duplicates.add();
+      break;
+    case reorder_buffer::duplicate:
+      RELM_TRACE(DEBUG, trace::received_duplicate, id_, seq);
+      st.metrics.duplicates.add();
+      break;
+    case reorder_buffer::beyond_window:
+      RELM_TRACE(DEBUG, trace::beyond_window, id_, seq, inbox.next());
+      // sender retransmits once we caught up
+      break;
+    case reorder_buffer::accepted:
+      // deliver the frame and all buffered successors in its stream, the
+      // ACK goes out with the next data frame or after the ack delay
+      if (seq != inbox.next())
+        st.metrics.out_of_order.add();
+      if (msg.has(fragment))
+        reserve_reassembly(st, msg);
+      inbox.drain([](reliable_msg&) {});
+      if (!msg.has(unordered)) {
+        receive_in_stream(move(msg));
+      } else if (msg.has(abandoned)) {
+        RELM_TRACE(DEBUG, trace::skipped, id_, seq);
+      } else {
+        RELM_TRACE(DEBUG, trace::received, id_, seq);
+        make_ready(move(msg));
+      }
+      deliver_ready();
+      break;
+  }
+  if (st.unacked >= ack_interval_count)
+    send_acks();
+  else if (st.unacked > 0)
+    schedule_acks();
+}
+
+void reliability_protocol::grant(uint32_t n) {
+  auto& st = state_;
+  st.credit += n;
+  deliver_ready();
+  // announce a reopened window right away, the peer may be stalled
+  if (st.advertised <= st.inbox.capacity() / 4
+      && receive_window(st) > st.advertised)
+    send_acks();
+}
+
+void reliability_protocol::fec_group_size(uint32_t n) {
+  state_.fec_adaptive = false;
+  state_.fec_out.group_size(n);
+}
+
+} // namespace relm
@@ -1,6 +1,7 @@
 
-#include <sstream>
+#include <string>
 
+#include "include/framing.hpp"
 #include "include/reliable_msg.hpp"
 
 using namespace std;
@@ -8,63 +9,134 @@ using namespace caf;
 
 namespace relm {
 
-reliable_msg reliable_msg::ack(int32_t seq) {
-  return reliable_msg{ack_atom::value, 0, seq, 0, {{0,0,0}}};
+reliable_msg reliable_msg::ack(seq_num seq) {
+  return ack(seq, {});
 }
 
-reliable_msg reliable_msg::ack(int32_t seq, int32_t num_nacks,
-                               std::array<int32_t, 3> nacks) {
-  return reliable_msg{ack_atom::value, 0, seq, num_nacks, std::move(nacks)};
+reliable_msg reliable_msg::ack(seq_num seq, std::vector<sack_range> sacks) {
+  reliable_msg res;
+  res.type = frame_type::ack;
+  res.flags = has_acks;
+  res.ack_seq = seq;
+  res.sacks = move(sacks);
+  return res;
 }
 
-reliable_msg reliable_msg::msg(atom_value atm, int32_t content, int32_t seq) {
-  return reliable_msg{move(atm), content, seq, 0, {{0,0,0}}};
+reliable_msg reliable_msg::msg(atom_value atm, int32_t content, seq_num seq) {
+  auto buf = make_buffer();
+  write_int(buf->bytes, content);
+  auto res = msg(atm, shared_payload{move(buf)}, seq);
+  res.flags |= scalar_payload;
+  return res;
+}
+
+reliable_msg reliable_msg::msg(atom_value atm, shared_payload payload,
+                               seq_num seq) {
+  reliable_msg res;
+  res.flags = has_payload;
+  res.seq = seq;
+  res.atm = atm;
+  res.payload = move(payload);
+  return res;
 }
 
 reliable_msg::reliable_msg()
-    : content{0},
+    : type{frame_type::data},
+      flags{0},
       seq{0},
-      num_nacks{0},
-      nacks{{0,0,0}} {
+      ack_seq{0},
+      window{0},
+      stream{0},
+      stream_seq{0},
+      atm{static_cast<atom_value>(0)},
+      fragment_index{0},
+      fragment_offset{0},
+      message_size{0} {
   // nop
 }
 
-reliable_msg::reliable_msg(caf::atom_value atm, int32_t content, int32_t seq,
-                           int32_t num_nacks, std::array<int32_t, 3> nacks)
-    : atm{move(atm)},
-      content{content},
-      seq{seq},
-      num_nacks{num_nacks},
-      nacks{move(nacks)} {
- // nop
+int32_t reliable_msg::content() const {
+  int32_t res = 0;
+  if (payload.size() >= sizeof(int32_t))
+    read_int(payload.data(), res);
+  return res;
 }
 
 bool reliable_msg::operator<(const reliable_msg& other) {
-  return this->seq < other.seq;
+  return seq_lt(this->seq, other.seq);
 }
 
 bool operator<(const reliable_msg& a, const reliable_msg& b) {
-  return a.seq < b.seq;
+  return seq_lt(a.seq, b.seq);
 }
 
 string to_string(const reliable_msg& msg) {
-  stringstream strm;
-  strm << "{atm: " << to_string(msg.atm) 
-       << ", content: " << std::to_string(msg.content)
-       << ", seq: " << std::to_string(msg.seq) 
-       << ", nacks: " << std::to_string(msg.num_nacks);
-  if (msg.num_nacks > 0) {
-    strm << " --> [";
-    for (int32_t i = 0; i < msg.num_nacks; ++i) {
-      strm << msg.nacks[i];
-      if (i + 1 < msg.num_nacks) {
-        strm << ", ";
+  // appends to a single string, called for every frame when tracing
+  string res;
+  res.reserve(64);
+  res += "{type: ";
+  switch (msg.type) {
+    case frame_type::data:
+      res += "data";
+      break;
+    case frame_type::ack:
+      res += "ack";
+      break;
+    case frame_type::parity:
+      res += "parity";
+      break;
+  }
+  res += ", seq: ";
+  res += std::to_string(msg.seq);
+  if (msg.has(has_payload)) {
+    res += ", stream: ";
+    res += std::to_string(msg.stream);
+    res += "/";
+    res += std::to_string(msg.stream_seq);
+    res += ", atm: ";
+    res += to_string(msg.atm);
+    if (msg.has(unordered))
+      res += ", unordered";
+    if (msg.has(fragment)) {
+      res += ", fragment: ";
+      res += std::to_string(msg.fragment_index);
+      res += " at ";
+      res += std::to_string(msg.fragment_offset);
+      res += "/";
+      res += std::to_string(msg.message_size);
+    }
+    if (msg.has(abandoned)) {
+      res += ", abandoned";
+    } else if (msg.has(scalar_payload)) {
+      res += ", content: ";
+      res += std::to_string(msg.content());
+    } else {
+      res += ", payload: ";
+      res += std::to_string(msg.payload.size());
+      res += " bytes";
+    }
+  }
+  if (msg.has(has_acks)) {
+    res += ", ack: ";
+    res += std::to_string(msg.ack_seq);
+    res += ", window: ";
+    res += std::to_string(msg.window);
+    res += ", sacks: ";
+    res += std::to_string(msg.sacks.size());
+    if (!msg.sacks.empty()) {
+      res += " --> [";
+      for (size_t i = 0; i < msg.sacks.size(); ++i) {
+        if (i > 0)
+          res += ", ";
+        res += std::to_string(msg.sacks[i].first);
+        res += "-";
+        res += std::to_string(msg.sacks[i].last);
       }
+      res += "]";
     }
-    strm << "]";
   }
-  strm << "}";
-  return strm.str();
+  res += "}";
+  return res;
 }
 
 } // namespace relm
@@ -0,0 +1,52 @@
+
+#include <algorithm>
+
+#include "include/reorder_buffer.hpp"
+
+namespace relm {
+
+reorder_buffer::reorder_buffer(size_t capacity, seq_num first)
+    : capacity_{std::max(capacity, size_t{1})},
+      slots_(ring_size(capacity_)),
+      bits_((slots_.size() + 63) / 64, 0),
+      next_{first},
+      highest_{first - 1},
+      size_{0} {
+  // nop
+}
+
+reorder_buffer::insert_result reorder_buffer::insert(seq_num seq,
+                                                     reliable_msg msg) {
+  if (seq_lt(seq, next_))
+    return old;
+  if (static_cast<seq_num>(seq - next_) >= capacity())
+    return beyond_window;
+  auto i = index(seq);
+  if (test(i))
+    return duplicate;
+  set(i);
+  ++size_;
+  highest_ = seq_max(highest_, seq);
+  slots_[i] = std::move(msg);
+  return accepted;
+}
+
+std::vector<sack_range> reorder_buffer::ranges(size_t max_ranges) const {
+  std::vector<sack_range> res;
+  if (empty())
+    return res;
+  auto seq = next_ + 1;
+  while (seq_le(seq, highest_) && res.size() < max_ranges) {
+    // skip the gap, then extend the range while frames are present
+    while (!test(index(seq)))
+      ++seq;
+    sack_range x{seq, seq};
+    while (x.last != highest_ && test(index(x.last + 1)))
+      ++x.last;
+    res.push_back(x);
+    seq = x.last + 1;
+  }
+  return res;
+}
+
+} // namespace relm
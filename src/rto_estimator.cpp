@@ -0,0 +1,51 @@
+
+#include <algorithm>
+
+#include "include/rto_estimator.hpp"
+
+namespace relm {
+
+rto_estimator::rto_estimator(duration initial, duration min, duration max,
+                             duration granularity)
+    : min_{min},
+      max_{std::max(min, max)},
+      granularity_{granularity},
+      srtt_{0},
+      rttvar_{0},
+      rto_{0},
+      has_sample_{false},
+      backoffs_{0} {
+  rto_ = clamp(initial);
+}
+
+rto_estimator::rto_estimator()
+    : rto_estimator(std::chrono::seconds(1), std::chrono::milliseconds(200),
+                    std::chrono::seconds(60), std::chrono::milliseconds(10)) {
+  // nop
+}
+
+void rto_estimator::sample(duration rtt) {
+  if (!has_sample_) {
+    srtt_ = rtt;
+    rttvar_ = rtt / 2;
+    has_sample_ = true;
+  } else {
+    // alpha = 1/8, beta = 1/4
+    auto err = srtt_ > rtt ? srtt_ - rtt : rtt - srtt_;
+    rttvar_ = (3 * rttvar_ + err) / 4;
+    srtt_ = (7 * srtt_ + rtt) / 8;
+  }
+  rto_ = clamp(srtt_ + std::max(granularity_, 4 * rttvar_));
+  backoffs_ = 0;
+}
+
+void rto_estimator::backoff() {
+  rto_ = clamp(rto_ * 2);
+  ++backoffs_;
+}
+
+rto_estimator::duration rto_estimator::clamp(duration x) const {
+  return std::min(std::max(x, min_), max_);
+}
+
+} // namespace relm
@@ -0,0 +1,42 @@
+
+#include <cassert>
+#include <algorithm>
+
+#include "include/send_window.hpp"
+
+namespace relm {
+
+send_window::send_window(size_t capacity, seq_num first)
+    : capacity_{std::max(capacity, size_t{1})},
+      slots_(ring_size(capacity_)),
+      base_{first},
+      next_{first},
+      outstanding_{0} {
+  // nop
+}
+
+send_window::entry& send_window::push(reliable_msg msg) {
+  assert(!full());
+  auto& x = slots_[index(next_)];
+  msg.seq = next_++;
+  x.used = true;
+  x.value.msg = std::move(msg);
+  ++outstanding_;
+  return x.value;
+}
+
+send_window::entry* send_window::find(seq_num seq) {
+  if (static_cast<seq_num>(seq - base_) >= size())
+    return nullptr;
+  auto& x = slots_[index(seq)];
+  return x.used ? &x.value : nullptr;
+}
+
+void send_window::release(slot& x) {
+  x.used = false;
+  --outstanding_;
+  // drop the payload, the slot may stay unused for a while
+  x.value = entry{};
+}
+
+} // namespace relm
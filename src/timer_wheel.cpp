@@ -0,0 +1,57 @@
+
+#include <algorithm>
+
+#include "include/timer_wheel.hpp"
+
+namespace relm {
+
+constexpr uint32_t timer_wheel::nil;
+
+timer_wheel::timer_wheel(size_t capacity, size_t num_slots)
+    : now_{0},
+      size_{0},
+      timers_(ring_size(capacity)),
+      slots_(std::max(num_slots, size_t{1}), nil) {
+  expired_.reserve(timers_.size());
+}
+
+void timer_wheel::arm(key_type key, size_t ticks) {
+  auto i = index(key);
+  if (timers_[i].armed)
+    unlink(i);
+  auto& x = timers_[i];
+  x.key = key;
+  x.deadline = now_ + std::max(ticks, size_t{1});
+  link(i);
+}
+
+void timer_wheel::cancel(key_type key) {
+  if (armed(key))
+    unlink(index(key));
+}
+
+void timer_wheel::link(uint32_t i) {
+  auto& x = timers_[i];
+  auto& head = slots_[x.deadline % slots_.size()];
+  x.prev = nil;
+  x.next = head;
+  if (head != nil)
+    timers_[head].prev = i;
+  head = i;
+  x.armed = true;
+  ++size_;
+}
+
+void timer_wheel::unlink(uint32_t i) {
+  auto& x = timers_[i];
+  if (x.prev != nil)
+    timers_[x.prev].next = x.next;
+  else
+    slots_[x.deadline % slots_.size()] = x.next;
+  if (x.next != nil)
+    timers_[x.next].prev = x.prev;
+  x.armed = false;
+  --size_;
+}
+
+} // namespace relm
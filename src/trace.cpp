@@ -0,0 +1,261 @@
+
+#include <mutex>
+#include <cctype>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <ostream>
+#include <algorithm>
+#include <condition_variable>
+
+#include "include/trace.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace relm {
+namespace trace {
+
+std::atomic<int> runtime_level{RELM_LEVEL_INFO};
+
+namespace {
+
+// Bounded multi-producer/multi-consumer queue after Dmitry Vyukov. Each
+// cell carries a sequence number that tells producers and consumers whether
+// it is free to write or ready to read, so neither side takes a lock.
+class record_ring {
+public:
+  explicit record_ring(size_t capacity)
+      : cells_(capacity),
+        mask_(capacity - 1) {
+    for (size_t i = 0; i < capacity; ++i)
+      cells_[i].seq.store(i, memory_order_relaxed);
+    enqueue_pos_.store(0, memory_order_relaxed);
+    dequeue_pos_.store(0, memory_order_relaxed);
+  }
+
+  bool push(const trace_record& x) {
+    auto pos = enqueue_pos_.load(memory_order_relaxed);
+    cell* c;
+    for (;;) {
+      c = &cells_[pos & mask_];
+      auto seq = c->seq.load(memory_order_acquire);
+      auto dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (dif == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               memory_order_relaxed))
+          break;
+      } else if (dif < 0) {
+        return false; // full
+      } else {
+        pos = enqueue_pos_.load(memory_order_relaxed);
+      }
+    }
+    c->data = x;
+    c->seq.store(pos + 1, memory_order_release);
+    return true;
+  }
+
+  bool pop(trace_record& x) {
+    auto pos = dequeue_pos_.load(memory_order_relaxed);
+    cell* c;
+    for (;;) {
+      c = &cells_[pos & mask_];
+      auto seq = c->seq.load(memory_order_acquire);
+      auto dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+      if (dif == 0) {
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               memory_order_relaxed))
+          break;
+      } else if (dif < 0) {
+        return false; // empty
+      } else {
+        pos = dequeue_pos_.load(memory_order_relaxed);
+      }
+    }
+    x = c->data;
+    c->seq.store(pos + mask_ + 1, memory_order_release);
+    return true;
+  }
+
+private:
+  struct cell {
+    std::atomic<size_t> seq;
+    trace_record data;
+  };
+
+  std::vector<cell> cells_;
+  size_t mask_;
+  alignas(64) std::atomic<size_t> enqueue_pos_;
+  alignas(64) std::atomic<size_t> dequeue_pos_;
+};
+
+// must be a power of two
+constexpr size_t ring_capacity = 1 << 16;
+
+record_ring ring{ring_capacity};
+std::atomic<uint64_t> num_dropped{0};
+
+const char* level_names[] = {
+  "OFF", "ERROR", "WARNING", "INFO", "DEBUG", "TRACE"
+};
+
+void format(ostream& out, const trace_record& x) {
+  out << x.time / 1000 << " " << level_names[x.level] << " [" << x.actor
+      << "][" << x.seq << "] ";
+  switch (static_cast<event>(x.event)) {
+    case sent:
+      out << "[<<] sent, " << x.a << " bytes payload";
+      break;
+    case retransmitted:
+      out << "[<<] retransmitted, transmission " << x.a << ", RTO "
+          << x.b << "ms";
+      break;
+    case fast_retransmitted:
+      out << "[<<] fast retransmitted";
+      break;
+    case ack_sent:
+      out << "[<<] ack, " << x.a << " SACK ranges";
+      break;
+    case ack_received:
+      out << "[>>] ack, " << x.a << " SACK ranges";
+      break;
+    case received:
+      out << "[>>] received";
+      break;
+    case received_old:
+      out << "[>>] <-- OLD, awaiting " << x.a;
+      break;
+    case received_duplicate:
+      out << "[>>] <-- DUPLICATE";
+      break;
+    case received_early:
+      out << "[>>] <-- EARLY, awaiting " << x.a;
+      break;
+    case beyond_window:
+      out << "[>>] <-- BEYOND WINDOW, awaiting " << x.a;
+      break;
+    case paused:
+      out << "send window full, paused application, backlog " << x.a;
+      break;
+    case resumed:
+      out << "backlog drained, resumed application";
+      break;
+    case lost:
+      out << "[X] lost";
+      break;
+    case delayed:
+      out << "[>>] delayed by " << x.a << "ms";
+      break;
+    case cwnd_reduced:
+      out << "congestion window reduced to " << x.a << ", ssthresh " << x.b;
+      break;
+    case abandoned:
+      out << "[<<] abandoned after " << x.a << " transmissions";
+      break;
+    case skipped:
+      out << "[>>] skipped, abandoned by the sender";
+      break;
+    case recovered:
+      out << "[>>] recovered from parity";
+      break;
+    default:
+      out << "unknown event " << static_cast<int>(x.event);
+  }
+  out << '\n';
+}
+
+// Formats records in the background until destroyed at program exit.
+class sink {
+public:
+  sink(ostream& out, milliseconds interval)
+      : out_(out),
+        done_(false),
+        thread_([=] { run(interval); }) {
+    // nop
+  }
+
+  ~sink() {
+    {
+      lock_guard<mutex> guard{mtx_};
+      done_ = true;
+    }
+    cv_.notify_one();
+    thread_.join();
+    drain(out_);
+    out_.flush();
+  }
+
+private:
+  void run(milliseconds interval) {
+    unique_lock<mutex> guard{mtx_};
+    while (!done_) {
+      cv_.wait_for(guard, interval);
+      drain(out_);
+      out_.flush();
+    }
+  }
+
+  ostream& out_;
+  mutex mtx_;
+  condition_variable cv_;
+  bool done_;
+  thread thread_;
+};
+
+// declared after `ring` so that it is destroyed first
+unique_ptr<sink> background_sink;
+
+} // namespace anonymous
+
+void set_level(int level) {
+  runtime_level.store(level, memory_order_relaxed);
+}
+
+int parse_level(const std::string& name) {
+  for (int i = RELM_LEVEL_OFF; i <= RELM_LEVEL_TRACE; ++i) {
+    std::string x = level_names[i];
+    if (x.size() == name.size()
+        && equal(x.begin(), x.end(), name.begin(),
+                 [](char a, char b) { return a == toupper(b); }))
+      return i;
+  }
+  return -1;
+}
+
+void record(int level, event ev, uint64_t actor, uint32_t seq, int64_t a,
+            int64_t b) {
+  trace_record x;
+  x.time = duration_cast<nanoseconds>(
+             steady_clock::now().time_since_epoch()).count();
+  x.actor = actor;
+  x.a = a;
+  x.b = b;
+  x.seq = seq;
+  x.level = static_cast<uint8_t>(level);
+  x.event = ev;
+  if (!ring.push(x))
+    num_dropped.fetch_add(1, memory_order_relaxed);
+}
+
+void start(ostream& out, milliseconds interval) {
+  if (!background_sink)
+    background_sink.reset(new sink(out, interval));
+}
+
+size_t drain(ostream& out) {
+  size_t res = 0;
+  trace_record x;
+  while (ring.pop(x)) {
+    format(out, x);
+    ++res;
+  }
+  return res;
+}
+
+uint64_t dropped() {
+  return num_dropped.load(memory_order_relaxed);
+}
+
+} // namespace trace
+} // namespace relm
@@ -2,6 +2,7 @@
 #include <vector>
 #include <string>
 #include <limits>
+#include <map>
 #include <memory>
 #include <random>
 #include <cstdint>
@@ -10,7 +11,9 @@
 
 #include <caf/config.hpp>
 
+#include "include/trace.hpp"
 #include "include/utility.hpp"
+#include "include/framing.hpp"
 #include "include/reliable_msg.hpp"
 #include "include/reliability_actor.hpp"
 #include "include/unreliable_broker.hpp"
@@ -23,32 +26,134 @@ using namespace caf::io;
 using namespace std::chrono;
 
 namespace {
-random_device rng;
-std::mt19937 gen{rng()};
-// same as negative_binomial_distribution<> d(1, 0.5):
-int32_t delay_multiplier = 500;
-geometric_distribution<> delay_distribution;
-bernoulli_distribution lost_distribution{0.90};
-} // namespace anonymous
 
-int write_int(broker* self, connection_handle hdl, uint64_t value) {
-  int res = 0;
-  res += write_int(self, hdl, static_cast<uint32_t>(value));
-  res += write_int(self, hdl, static_cast<uint32_t>(value >> sizeof(uint32_t)));
+struct connection_state {
+  // frames written to the connection since the last flush ...
+  size_t pending = 0;
+  // ... and their encoded size
+  size_t pending_bytes = 0;
+  bool linger_timer_set = false;
+  // trailing bytes of a frame split across reads
+  byte_buffer partial;
+  // simulated network for incoming frames
+  impairment link;
+};
+
+// Returns the number of flushed bytes.
+size_t flush(broker* self, connection_handle hdl, connection_state& st) {
+  if (st.pending == 0)
+    return 0;
+  self->flush(hdl);
+  auto res = st.pending_bytes;
+  st.pending = 0;
+  st.pending_bytes = 0;
   return res;
 }
 
-int read_int(const void* data, uint64_t& storage) {
-  uint32_t first;
-  uint32_t second;
-  int res = 0;
-  res += read_int(data, first);
-  res += read_int(reinterpret_cast<const char*>(data) + sizeof(uint32_t), second);
-  storage = first | (static_cast<uint64_t>(second) << sizeof(uint32_t));
-  return res;
+// Serializes `msg` directly into the write buffer and flushes once per batch.
+// Returns the number of flushed bytes.
+size_t write(broker* self, connection_handle hdl, connection_state& st,
+             const broker_config& cfg, const reliable_msg& msg) {
+  auto& buf = self->wr_buf(hdl);
+  auto before = buf.size();
+  encode(buf, msg);
+  st.pending += 1;
+  st.pending_bytes += buf.size() - before;
+  if (st.pending >= cfg.batch_size || cfg.linger.count() == 0)
+    return flush(self, hdl, st);
+  if (!st.linger_timer_set) {
+    st.linger_timer_set = true;
+    self->delayed_send(self, cfg.linger, flush_atom::value);
+  }
+  return 0;
+}
+
+// Decodes all complete frames of `incoming`, keeping a trailing partial frame
+// for the next read, and passes each frame through the simulated network.
+// Calls `f(msg, delay)` with its own frame for each copy that survives.
+// Returns false if the peer sent a malformed frame.
+template <class F>
+bool read(broker* self, connection_state& st, const new_data_msg& incoming,
+          F f) {
+  auto forward = [&](const frame_view& frame) {
+    auto fate = st.link.apply(impairment::clock::now(), frame.size());
+    if (fate.copies == 0) {
+      RELM_TRACE(TRACE, trace::lost, self->id(), frame.seq);
+      return;
+    }
+    auto msg = frame.to_msg();
+    for (size_t i = 0; i < fate.copies; ++i) {
+      auto delay = fate.delays[i];
+      if (delay.count() > 0)
+        RELM_TRACE(TRACE, trace::delayed, self->id(), frame.seq,
+                   duration_cast<milliseconds>(delay).count());
+      if (i + 1 < fate.copies)
+        f(reliable_msg{msg}, delay);
+      else
+        f(move(msg), delay);
+    }
+  };
+  // decode in place unless a previous read ended within a frame
+  auto& partial = st.partial;
+  auto data = incoming.buf.data();
+  auto size = incoming.buf.size();
+  if (!partial.empty()) {
+    partial.insert(partial.end(), incoming.buf.begin(), incoming.buf.end());
+    data = partial.data();
+    size = partial.size();
+  }
+  size_t consumed = 0;
+  if (decode_all(data, size, consumed, forward) == decode_status::malformed)
+    return false;
+  if (partial.empty())
+    partial.assign(data + consumed, data + size);
+  else
+    partial.erase(partial.begin(), partial.begin() + consumed);
+  return true;
+}
+
+} // namespace anonymous
+
+void impairment_options::add(actor_system_config::opt_group& grp) {
+  grp.add(seed, "seed", "set impairment RNG seed (0: random)")
+  .add(loss_model, "loss-model",
+       "set loss model (bernoulli, gilbert-elliott)")
+  .add(loss_rate, "loss-rate", "set probability of dropping a frame")
+  .add(ge_p, "ge-p", "set probability of entering the bad state")
+  .add(ge_r, "ge-r", "set probability of leaving the bad state")
+  .add(ge_loss_good, "ge-loss-good", "set loss rate in the good state")
+  .add(ge_loss_bad, "ge-loss-bad", "set loss rate in the bad state")
+  .add(delay_ms, "delay", "set scale of the frame delay (ms)")
+  .add(delay_model, "delay-model",
+       "set delay distribution (constant, geometric, uniform)")
+  .add(reorder_rate, "reorder-rate", "set probability of holding a frame back")
+  .add(reorder_delay_ms, "reorder-delay", "set hold back time (ms)")
+  .add(duplicate_rate, "duplicate-rate",
+       "set probability of delivering a frame twice")
+  .add(bandwidth, "bandwidth", "set link capacity (bytes/s, 0: unlimited)");
+}
+
+string impairment_options::convert(impairment_config& x) const {
+  if (!parse_loss_model(loss_model, x.losses))
+    return "invalid loss model: " + loss_model;
+  if (!parse_delay_model(delay_model, x.delays))
+    return "invalid delay model: " + delay_model;
+  x.seed = seed != 0 ? seed : random_device{}();
+  x.loss_rate = loss_rate;
+  x.ge_p = ge_p;
+  x.ge_r = ge_r;
+  x.ge_loss_good = ge_loss_good;
+  x.ge_loss_bad = ge_loss_bad;
+  x.delay = milliseconds{delay_ms};
+  x.reorder_rate = reorder_rate;
+  x.reorder_delay = milliseconds{reorder_delay_ms};
+  x.duplicate_rate = duplicate_rate;
+  x.bandwidth = bandwidth;
+  return {};
 }
 
-behavior broker_impl(broker* self, connection_handle hdl, const actor& buddy) {
+behavior broker_impl(broker* self, connection_handle hdl, const actor& buddy,
+                     const broker_config& cfg) {
   // assumption: we manage exactly one connection`
   assert(self->num_connections() == 1);
   self->monitor(buddy);
@@ -59,8 +164,10 @@ behavior broker_impl(broker* self, connection_handle hdl, const actor& buddy) {
     }
   });
   self->send(buddy, register_atom::value, self);
-  // Each exchanged message is a reliable_msg to make thing easier here
-  self->configure_read(hdl, receive_policy::exactly(sizeof(reliable_msg)));
+  // frames are length-prefixed, read as much as is available
+  self->configure_read(hdl, receive_policy::at_most(max_read_size));
+  auto state = std::make_shared<connection_state>();
+  state->link = impairment{cfg.impairment};
   return {
     [=](const connection_closed_msg& msg) {
       if (msg.handle == hdl) {
@@ -70,51 +177,129 @@ behavior broker_impl(broker* self, connection_handle hdl, const actor& buddy) {
       }
     },
     [=](const new_data_msg& incoming) {
-      int offset = 0;
-      reliable_msg msg;
-      uint64_t atm_val;
-      offset += read_int(incoming.buf.data(), atm_val);
-      msg.atm = static_cast<atom_value>(atm_val);
-      offset += read_int(incoming.buf.data() + offset, msg.content);
-      offset += read_int(incoming.buf.data() + offset, msg.seq);
-      offset += read_int(incoming.buf.data() + offset, msg.num_nacks);
-      offset += read_int(incoming.buf.data() + offset, msg.nacks[0]);
-      offset += read_int(incoming.buf.data() + offset, msg.nacks[1]);
-      offset += read_int(incoming.buf.data() + offset, msg.nacks[2]);
-      // loose some messages
-      if (lost_distribution(gen)) {
-        // "network" delay for the rest
-        auto delay = milliseconds{delay_distribution(gen) * delay_multiplier};
-        // aout(self) << "[B][" << msg.seq << "][>>] " << to_string(msg)
-                   // << " with " << delay.count() << "ms delay" << endl;
-        self->delayed_send(buddy, delay, recv_atom::value, msg);
-      } else {
-        // aout(self) << "[B][" << msg.seq << "][X] " << to_string(msg) << endl;
+      auto forward = [=](reliable_msg msg, impairment::duration delay) {
+        if (delay.count() == 0)
+          self->send(buddy, recv_atom::value, move(msg));
+        else
+          self->delayed_send(buddy, delay, recv_atom::value, move(msg));
+      };
+      if (!read(self, *state, incoming, forward)) {
+        aout(self) << "[B] Received malformed frame." << endl;
+        self->send_exit(buddy, exit_reason::remote_link_unreachable);
+        self->quit(exit_reason::remote_link_unreachable);
       }
     },
     [=] (send_atom, const reliable_msg& msg) {
-      write_int(self, hdl, static_cast<uint64_t>(msg.atm));
-      write_int(self, hdl, msg.content);
-      write_int(self, hdl, msg.seq);
-      write_int(self, hdl, msg.num_nacks);
-      for (auto& nack : msg.nacks) {
-        write_int(self, hdl, nack);
+      auto n = write(self, hdl, *state, cfg, msg);
+      if (n > 0)
+        self->send(buddy, written_atom::value, static_cast<uint64_t>(n));
+    },
+    [=](flush_atom) {
+      state->linger_timer_set = false;
+      auto n = flush(self, hdl, *state);
+      if (n > 0)
+        self->send(buddy, written_atom::value, static_cast<uint64_t>(n));
+    }
+  };
+}
+
+behavior fused_broker(broker* self, connection_handle hdl, const actor& app,
+                      const reliability_config& rcfg,
+                      const broker_config& cfg) {
+  assert(self->num_connections() == 1);
+  self->monitor(app);
+  self->set_down_handler([=](down_msg& dm) {
+    if (dm.source == app) {
+      aout(self) << "[B] Application is down." << endl;
+      self->quit(dm.reason);
+    }
+  });
+  self->configure_read(hdl, receive_policy::at_most(max_read_size));
+  auto state = std::make_shared<connection_state>();
+  state->link = impairment{cfg.impairment};
+  auto protocol = std::make_shared<reliability_protocol>();
+  protocol->init(rcfg);
+  // frames go straight into the write buffer, only delivery and
+  // back-pressure leave the broker as messages
+  auto p = protocol.get();
+  protocol->start(actor_hooks(self, app, [=](const reliable_msg& msg) {
+    auto n = write(self, hdl, *state, cfg, msg);
+    if (n > 0)
+      p->written(n);
+  }), self->id());
+  message_handler io_handlers{
+    [=](const connection_closed_msg& msg) {
+      if (msg.handle == hdl) {
+        aout(self) << "[B] Connection closed." << endl;
+        self->quit(exit_reason::remote_link_unreachable);
       }
+    },
+    [=](const new_data_msg& incoming) {
+      // only frames delayed by the simulated network take a detour through
+      // the mailbox
+      auto forward = [=](reliable_msg msg, impairment::duration delay) {
+        if (delay.count() == 0)
+          protocol->receive(msg);
+        else
+          self->delayed_send(self, delay, recv_atom::value, move(msg));
+      };
+      if (!read(self, *state, incoming, forward)) {
+        aout(self) << "[B] Received malformed frame." << endl;
+        self->quit(exit_reason::remote_link_unreachable);
+      }
+    },
+    [=](recv_atom, reliable_msg& msg) {
+      protocol->receive(msg);
+    },
+    [=](flush_atom) {
+      state->linger_timer_set = false;
+      auto n = flush(self, hdl, *state);
+      if (n > 0)
+        protocol->written(n);
     }
   };
+  return io_handlers.or_else(protocol_handlers(protocol.get()));
 }
 
-behavior server(broker* self, const actor& buddy) {
+behavior server(broker* self, const app_factory& make_app,
+                const reliability_config& rcfg, const broker_config& cfg) {
   aout(self) << "Server is running." << endl;
+  // application of each running session, keyed by its reliability actor
+  auto sessions = std::make_shared<std::map<actor_addr, actor>>();
+  auto connections = std::make_shared<uint64_t>(0);
+  self->set_down_handler([=](down_msg& dm) {
+    auto i = sessions->find(dm.source);
+    if (i != sessions->end()) {
+      self->send_exit(i->second, dm.reason);
+      sessions->erase(i);
+    }
+  });
+  self->set_exit_handler([=](exit_msg& msg) {
+    for (auto& kvp : *sessions)
+      self->send_exit(kvp.second, msg.reason);
+    sessions->clear();
+    self->quit(msg.reason);
+  });
   return {
     [=](const new_connection_msg& msg) {
       aout(self) << "Server accepted new connection." << endl;
+      // every peer gets its own session, the scheduler spreads the
+      // reliability actors over its workers
+      auto app = make_app(self->system());
+      // the client uses the configured seed, connection n uses seed + n
+      auto conn_cfg = cfg;
+      conn_cfg.impairment.seed += ++*connections;
       // by forking into a new broker, we are no longer
       // responsible for the connection
-      auto impl = self->fork(broker_impl, msg.handle, buddy);
-      print_on_exit(impl, "broker_impl");
-      aout(self) << "Quit server (only accept 1 connection)." << endl;
-      self->quit();
+      actor session;
+      if (cfg.fused) {
+        session = self->fork(fused_broker, msg.handle, app, rcfg, conn_cfg);
+      } else {
+        session = self->spawn(init_reliability_actor, app, rcfg);
+        self->fork(broker_impl, msg.handle, session, conn_cfg);
+      }
+      self->monitor(session);
+      sessions->emplace(session.address(), app);
     }
   };
 }